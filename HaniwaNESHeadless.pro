@@ -0,0 +1,16 @@
+# console build without Qt and SDL: runs emulator headless and unthrottled(for testing, bots etc.)
+TEMPLATE = app
+TARGET = HaniwaNESHeadless
+CONFIG += console c++17
+CONFIG -= app_bundle qt
+
+QMAKE_CXXFLAGS += -std=c++17
+
+LIBS += -lpthread
+
+include(core.pri)
+
+SOURCES += headless/main.cpp \
+    headless/selftest.cpp
+
+HEADERS += headless/selftest.hpp
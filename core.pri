@@ -0,0 +1,53 @@
+# emulator core without GUI, shared by GUI(HaniwaNES.pro) and headless(HaniwaNESHeadless.pro) builds
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/core/cpu.cpp \
+    $$PWD/core/memory.cpp \
+    $$PWD/log/log.cpp \
+    $$PWD/core/rom.cpp \
+    $$PWD/core/mappers/mapper0.cpp \
+    $$PWD/core/common.cpp \
+    $$PWD/core/ppu.cpp \
+    $$PWD/core/ppumemory.cpp \
+    $$PWD/core/mappers/mapperinterface.cpp \
+    $$PWD/nes.cpp \
+    $$PWD/core/mappers/mappers.cpp \
+    $$PWD/serialize/serializer.cpp \
+    $$PWD/core/input.cpp \
+    $$PWD/core/mappers/mapper1.cpp \
+    $$PWD/core/mappers/mapper4.cpp \
+    $$PWD/core/decodecache.cpp \
+    $$PWD/core/chrcache.cpp \
+    $$PWD/core/compositor.cpp \
+    $$PWD/core/frameconverter.cpp \
+    $$PWD/core/rewind.cpp \
+    $$PWD/core/jit.cpp
+
+HEADERS += \
+    $$PWD/core/include/cpu.hpp \
+    $$PWD/core/include/common.hpp \
+    $$PWD/core/include/memory.hpp \
+    $$PWD/log/log.hpp \
+    $$PWD/core/include/rom.hpp \
+    $$PWD/core/include/mappers/mapper0.hpp \
+    $$PWD/core/include/mappers/mapperinterface.hpp \
+    $$PWD/core/include/mappers/mappers.hpp \
+    $$PWD/debug/debug.hpp \
+    $$PWD/core/include/ppu.hpp \
+    $$PWD/core/include/ppumemory.hpp \
+    $$PWD/core/include/eventqueue.hpp \
+    $$PWD/observer/observer.hpp \
+    $$PWD/nes.hpp \
+    $$PWD/serialize/serializer.hpp \
+    $$PWD/core/include/input.hpp \
+    $$PWD/core/include/mappers/mapper1.hpp \
+    $$PWD/core/include/mappers/mapper4.hpp \
+    $$PWD/core/include/framequeue.hpp \
+    $$PWD/core/include/decodecache.hpp \
+    $$PWD/core/include/chrcache.hpp \
+    $$PWD/core/include/compositor.hpp \
+    $$PWD/core/include/frameconverter.hpp \
+    $$PWD/core/include/snapshot.hpp \
+    $$PWD/core/include/rewind.hpp \
+    $$PWD/core/include/jit.hpp
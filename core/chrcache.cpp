@@ -0,0 +1,36 @@
+#include "include/chrcache.hpp"
+
+// mapper has at least 8 KB of CHR(CHR-RAM, if ROM has no CHR)
+CHRCache::CHRCache(MapperInterface& _mapper)
+    : mapper{_mapper}, entries(_mapper.chrSize()), pages{} {
+    _load();
+    _mapPages();
+    mapper.attach(this);
+}
+
+CHRCache::~CHRCache() {
+    mapper.detach(this);
+}
+
+void CHRCache::refresh(Address address) {
+    auto val = mapper.readCHR(address);
+    if(!val) return;
+    PatternByte& entry = pages[(address >> 10) & 0b111][address & (PageSize - 1)];
+    entry = PatternByte{val.value(), reverseByte(val.value())};
+}
+
+void CHRCache::update(MapperInterface*, int eventType) {
+    if(eventType == (int)MapperEvent::CHRBanksSwitched) _mapPages();
+    else if(eventType == (int)MapperEvent::CHRRAMLoaded) _load();
+}
+
+void CHRCache::_load() {
+    for(std::size_t i = 0; i < mapper.chrSize(); ++i) {
+        u8 val = mapper.chr()[i];
+        entries[i] = PatternByte{val, reverseByte(val)};
+    }
+}
+
+void CHRCache::_mapPages() {
+    for(int page = 0; page < 8; ++page) pages[page] = &entries[mapper.chrOffset(page * PageSize)];
+}
@@ -0,0 +1,54 @@
+#include "include/compositor.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+void Compositor::composeScalar(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out) {
+    for(std::size_t i = 0; i < ScanlineWidth; ++i) {
+        out[i] = ((spritesMask[i] ? sprites[i] : bckg[i]) & colorMask) | emphasis;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 16 pixels per iteration
+__attribute__((target("sse2")))
+void Compositor::composeSSE2(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out) {
+    const __m128i color = _mm_set1_epi8(colorMask);
+    const __m128i emph = _mm_set1_epi16(emphasis);
+    const __m128i zero = _mm_setzero_si128();
+    for(std::size_t i = 0; i < ScanlineWidth; i += 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bckg + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + i));
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(spritesMask + i));
+        __m128i pixels = _mm_and_si128(_mm_or_si128(_mm_and_si128(m, s), _mm_andnot_si128(m, b)), color);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(_mm_unpacklo_epi8(pixels, zero), emph));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_or_si128(_mm_unpackhi_epi8(pixels, zero), emph));
+    }
+}
+
+// 32 pixels per iteration
+__attribute__((target("avx2")))
+void Compositor::composeAVX2(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out) {
+    const __m256i color = _mm256_set1_epi8(colorMask);
+    const __m256i emph = _mm256_set1_epi16(emphasis);
+    for(std::size_t i = 0; i < ScanlineWidth; i += 32) {
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bckg + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprites + i));
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(spritesMask + i));
+        __m256i pixels = _mm256_and_si256(_mm256_blendv_epi8(b, s, m), color);
+        __m256i low = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(pixels));
+        __m256i high = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(pixels, 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(low, emph));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 16), _mm256_or_si256(high, emph));
+    }
+}
+#endif
+
+Compositor::ComposeFunction Compositor::best() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return composeAVX2;
+    if(__builtin_cpu_supports("sse2")) return composeSSE2;
+#endif
+    return composeScalar;
+}
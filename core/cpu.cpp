@@ -1,4 +1,5 @@
 #include "include/cpu.hpp"
+#include "include/snapshot.hpp"
 #include <string>
 #include <thread>
 #include <chrono>
@@ -6,107 +7,156 @@
 
 // P = 0x34 - interruptions disabled, b-bits are set
 Registers::Registers()
-    : A{0}, X{0}, Y{0}, S{0xFD}, P{0x34} {}
+    : A{0}, X{0}, Y{0}, S{0xFD}, nz{1}, c{0}, v{0}, flags{0x34} {}
+
+// length of instruction in bytes(opcode + operand)
+constexpr u8 instructionLength(AddressationMode mode) {
+    switch(mode) {
+    case AddressationMode::Implied:
+    case AddressationMode::Accumulator:
+        return 1;
+    case AddressationMode::Absolute:
+    case AddressationMode::AbsoluteX:
+    case AddressationMode::AbsoluteY:
+    case AddressationMode::Indirect:
+        return 3;
+    default:
+        return 2;
+    }
+}
 
 /*
-    offset should point to current opcode
+    offset should point to current opcode, operand - raw bytes following the opcode(already fetched, maybe from decode cache)
     return address, 8bit value read from the address, 16 bit value, length of instruction and cycles count(basic minimal value for this addressation mode)
         (some special instruction like BRK may change this value later)
+    Addressation mode and cycles are template parameters, so every opcode gets its own specialized decoder.
 */
-Instruction makeInstruction(CPU& cpu, AddressationMode addrMode, Address offset, u8 opcode) {
-    // skipping opcode
-    ++offset;
+template<AddressationMode Mode, u8 Cycles, u8 PageCrossCycles>
+Instruction makeInstruction(CPU& cpu, Address offset, u8 opcode, u16 operand) {
     Address addr = 0;
     u16 argument = 0;
-    u8 length = 1;      // at least opcode
-    u8 cycles = 0;
+    u8 length = instructionLength(Mode);
     std::optional<u8> val8 = std::nullopt;
     Memory& memory = cpu.getMemory();
     const Registers& registers = cpu.registers();
     // cross page can occure when using AbsoluteX, AbsoluteY or IndirectIndexed modes
     bool crossPage = false;
-    if (addrMode == AddressationMode::Implied || addrMode == AddressationMode::Accumulator) {
+    if constexpr (Mode == AddressationMode::Implied || Mode == AddressationMode::Accumulator) {
         addr = 0;
         argument = 0;
-        length = 1;
     }
-    else if (addrMode == AddressationMode::Immediate) {
+    else if constexpr (Mode == AddressationMode::Immediate) {
         addr = 0;
         argument = 0;
-        length = 2;
-        val8 = memory.read8(offset);
+        val8 = operand;
     }
-    else if (addrMode == AddressationMode::ZeroPage) {
-        addr = memory.read8(offset);
+    else if constexpr (Mode == AddressationMode::ZeroPage) {
+        addr = operand;
         argument = addr;
-        length = 2;
     }
-    else if (addrMode == AddressationMode::ZeroPageX) {
-        argument = memory.read8(offset);
+    else if constexpr (Mode == AddressationMode::ZeroPageX) {
+        argument = operand;
         addr = (argument + registers.X) % 0x100;
-        length = 2;
     }
-    else if (addrMode == AddressationMode::ZeroPageY) {
-        argument = memory.read8(offset);
+    else if constexpr (Mode == AddressationMode::ZeroPageY) {
+        argument = operand;
         addr = (argument + registers.Y) % 0x100;
-        length = 2;
     }
-    else if (addrMode == AddressationMode::Relative) {
-        argument = memory.read8(offset);
-        // +1 because relative offset is calculated from place AFTER the instruction(and any relative addressing instruction has size 2 bytes)
-        addr = offset + 1 + (i8)(argument);
-        length = 2;
+    else if constexpr (Mode == AddressationMode::Relative) {
+        argument = operand;
+        // relative offset is calculated from place AFTER the instruction(and any relative addressing instruction has size 2 bytes)
+        addr = offset + 2 + (i8)(argument);
     }
-    else if (addrMode == AddressationMode::Absolute) {
-        argument = memory.read16(offset);
+    else if constexpr (Mode == AddressationMode::Absolute) {
+        argument = operand;
         addr = argument;
-        length = 3;
     }
-    else if (addrMode == AddressationMode::AbsoluteX) {
-        argument = memory.read16(offset);
+    else if constexpr (Mode == AddressationMode::AbsoluteX) {
+        argument = operand;
         addr = argument + registers.X;
         crossPage = (argument & 255) != (addr & 255);
-        length = 3;
     }
-    else if (addrMode == AddressationMode::AbsoluteY) {
-        argument = memory.read16(offset);
+    else if constexpr (Mode == AddressationMode::AbsoluteY) {
+        argument = operand;
         addr = argument + registers.Y;
         crossPage = (argument & 255) != (addr & 255);
-        length = 3;
     }
-    else if (addrMode == AddressationMode::Indirect) {
-        argument = memory.read16(offset);
+    else if constexpr (Mode == AddressationMode::Indirect) {
+        argument = operand;
         addr = memory.read16(argument);
-        length = 3;
     }
-    else if (addrMode == AddressationMode::IndexedIndirect) {
-        argument = memory.read8(offset);
+    else if constexpr (Mode == AddressationMode::IndexedIndirect) {
+        argument = operand;
         addr = memory.read16(argument + registers.X);
-        length = 2;
     }
-    else if (addrMode == AddressationMode::IndirectIndexed) {
-        argument = memory.read8(offset);
+    else if constexpr (Mode == AddressationMode::IndirectIndexed) {
+        argument = operand;
         Address base = memory.read16(argument);
         addr = base + registers.Y;
         crossPage = (base & 255) != (addr & 255);
-        length = 2;
-    }
-    else {
-        throw UnknownAddressModeException{};
     }
-    cycles = CyclesByOpcode[opcode];
-    switch(opcode) {
-    case 0x7D: case 0x79: case 0x71: case 0x3D: case 0x39: case 0x31: case 0xDD: case 0xD9: case 0xD1: case 0x5D: case 0x59: case 0x51:
-    case 0xBD: case 0xB9: case 0xB1: case 0xBE: case 0xBC: case 0x1D: case 0x19: case 0x11: case 0xFD: case 0xF9: case 0xF1: {
-        if(crossPage) cycles += 1;
-        break;
-    }
-    }
-    return Instruction{&memory, val8, addr, argument, length, cycles, addrMode, offset - 1, opcode};
+    // some instructions take one more cycle if page is crossed
+    u8 cycles = Cycles + (crossPage ? PageCrossCycles : 0);
+    return Instruction{&memory, val8, addr, argument, length, cycles, Mode, offset, opcode};
 }
 
+struct OpcodeDescription {
+    Operation operation;
+    AddressationMode addrMode;
+    u8 cycles;
+    u8 pageCrossCycles;     // added to cycles if page is crossed
+};
+
+using Op = Operation;
+
+// unofficial opcodes keep their addressation modes, so they are skipped as NOPs of right length
+constexpr std::array<OpcodeDescription, 256> OpcodeDescriptions = {{
+    /* 0x00 */ {Op::BRK, IML, 7, 0}, {Op::ORA, IIR, 6, 0}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIR, 0, 0}, {Op::UNK, ZP0, 0, 0}, {Op::ORA, ZP0, 3, 0}, {Op::ASL, ZP0, 5, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0x08 */ {Op::PHP, IML, 3, 0}, {Op::ORA, IMM, 2, 0}, {Op::ASL, ACC, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::UNK, ABS, 0, 0}, {Op::ORA, ABS, 4, 0}, {Op::ASL, ABS, 6, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0x10 */ {Op::BPL, REL, 2, 0}, {Op::ORA, IIX, 5, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::UNK, ZPX, 0, 0}, {Op::ORA, ZPX, 4, 0}, {Op::ASL, ZPX, 6, 0}, {Op::UNK, ZPX, 0, 0},
+    /* 0x18 */ {Op::CLC, IML, 2, 0}, {Op::ORA, ABY, 4, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABX, 0, 0}, {Op::ORA, ABX, 4, 1}, {Op::ASL, ABX, 7, 0}, {Op::UNK, ABX, 0, 0},
+    /* 0x20 */ {Op::JSR, ABS, 6, 0}, {Op::AND, IIR, 6, 0}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIR, 0, 0}, {Op::BIT, ZP0, 3, 0}, {Op::AND, ZP0, 3, 0}, {Op::ROL, ZP0, 5, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0x28 */ {Op::PLP, IML, 4, 0}, {Op::AND, IMM, 2, 0}, {Op::ROL, ACC, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::BIT, ABS, 4, 0}, {Op::AND, ABS, 4, 0}, {Op::ROL, ABS, 6, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0x30 */ {Op::BMI, REL, 2, 0}, {Op::AND, IIX, 5, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::UNK, ZPX, 0, 0}, {Op::AND, ZPX, 4, 0}, {Op::ROL, ZPX, 6, 0}, {Op::UNK, ZPX, 0, 0},
+    /* 0x38 */ {Op::SEC, IML, 2, 0}, {Op::AND, ABY, 4, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABX, 0, 0}, {Op::AND, ABX, 4, 1}, {Op::ROL, ABX, 7, 0}, {Op::UNK, ABX, 0, 0},
+    /* 0x40 */ {Op::RTI, IML, 6, 0}, {Op::EOR, IIR, 6, 0}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIR, 0, 0}, {Op::UNK, ZP0, 0, 0}, {Op::EOR, ZP0, 3, 0}, {Op::LSR, ZP0, 5, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0x48 */ {Op::PHA, IML, 3, 0}, {Op::EOR, IMM, 2, 0}, {Op::LSR, ACC, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::JMP, ABS, 3, 0}, {Op::EOR, ABS, 4, 0}, {Op::LSR, ABS, 6, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0x50 */ {Op::BVC, REL, 2, 0}, {Op::EOR, IIX, 5, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::UNK, ZPX, 0, 0}, {Op::EOR, ZPX, 4, 0}, {Op::LSR, ZPX, 6, 0}, {Op::UNK, ZPX, 0, 0},
+    /* 0x58 */ {Op::CLI, IML, 2, 0}, {Op::EOR, ABY, 4, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABX, 0, 0}, {Op::EOR, ABX, 4, 1}, {Op::LSR, ABX, 7, 0}, {Op::UNK, ABX, 0, 0},
+    /* 0x60 */ {Op::RTS, IML, 6, 0}, {Op::ADC, IIR, 6, 0}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIR, 0, 0}, {Op::UNK, ZP0, 0, 0}, {Op::ADC, ZP0, 3, 0}, {Op::ROR, ZP0, 5, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0x68 */ {Op::PLA, IML, 4, 0}, {Op::ADC, IMM, 2, 0}, {Op::ROR, ACC, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::JMP, IND, 5, 0}, {Op::ADC, ABS, 4, 0}, {Op::ROR, ABS, 6, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0x70 */ {Op::BVS, REL, 2, 0}, {Op::ADC, IIX, 5, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::UNK, ZPX, 0, 0}, {Op::ADC, ZPX, 4, 0}, {Op::ROR, ZPX, 6, 0}, {Op::UNK, ZPX, 0, 0},
+    /* 0x78 */ {Op::SEI, IML, 2, 0}, {Op::ADC, ABY, 4, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABX, 0, 0}, {Op::ADC, ABX, 4, 1}, {Op::ROR, ABX, 7, 0}, {Op::UNK, ABX, 0, 0},
+    /* 0x80 */ {Op::UNK, IMM, 0, 0}, {Op::STA, IIR, 6, 0}, {Op::UNK, IMM, 0, 0}, {Op::UNK, IIR, 0, 0}, {Op::STY, ZP0, 3, 0}, {Op::STA, ZP0, 3, 0}, {Op::STX, ZP0, 3, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0x88 */ {Op::DEY, IML, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::TXA, IML, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::STY, ABS, 4, 0}, {Op::STA, ABS, 4, 0}, {Op::STX, ABS, 4, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0x90 */ {Op::BCC, REL, 2, 0}, {Op::STA, IIX, 6, 0}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::STY, ZPX, 4, 0}, {Op::STA, ZPX, 4, 0}, {Op::STX, ZPY, 4, 0}, {Op::UNK, ZPY, 0, 0},
+    /* 0x98 */ {Op::TYA, IML, 2, 0}, {Op::STA, ABY, 5, 0}, {Op::TXS, IML, 2, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABX, 0, 0}, {Op::STA, ABX, 5, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABY, 0, 0},
+    /* 0xA0 */ {Op::LDY, IMM, 2, 0}, {Op::LDA, IIR, 6, 0}, {Op::LDX, IMM, 2, 0}, {Op::UNK, IIR, 0, 0}, {Op::LDY, ZP0, 3, 0}, {Op::LDA, ZP0, 3, 0}, {Op::LDX, ZP0, 3, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0xA8 */ {Op::TAY, IML, 2, 0}, {Op::LDA, IMM, 2, 0}, {Op::TAX, IML, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::LDY, ABS, 4, 0}, {Op::LDA, ABS, 4, 0}, {Op::LDX, ABS, 4, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0xB0 */ {Op::BCS, REL, 2, 0}, {Op::LDA, IIX, 5, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::LDY, ZPX, 4, 0}, {Op::LDA, ZPX, 4, 0}, {Op::LDX, ZPY, 4, 0}, {Op::UNK, ZPY, 0, 0},
+    /* 0xB8 */ {Op::CLV, IML, 2, 0}, {Op::LDA, ABY, 4, 1}, {Op::TSX, IML, 2, 0}, {Op::UNK, ABY, 0, 0}, {Op::LDY, ABX, 4, 1}, {Op::LDA, ABX, 4, 1}, {Op::LDX, ABY, 4, 1}, {Op::UNK, ABY, 0, 0},
+    /* 0xC0 */ {Op::CPY, IMM, 2, 0}, {Op::CMP, IIR, 6, 0}, {Op::UNK, IMM, 0, 0}, {Op::UNK, IIR, 0, 0}, {Op::CPY, ZP0, 3, 0}, {Op::CMP, ZP0, 3, 0}, {Op::DEC, ZP0, 5, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0xC8 */ {Op::INY, IML, 2, 0}, {Op::CMP, IMM, 2, 0}, {Op::DEX, IML, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::CPY, ABS, 4, 0}, {Op::CMP, ABS, 4, 0}, {Op::DEC, ABS, 6, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0xD0 */ {Op::BNE, REL, 2, 0}, {Op::CMP, IIX, 5, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::UNK, ZPX, 0, 0}, {Op::CMP, ZPX, 4, 0}, {Op::DEC, ZPX, 6, 0}, {Op::UNK, ZPX, 0, 0},
+    /* 0xD8 */ {Op::CLD, IML, 2, 0}, {Op::CMP, ABY, 4, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABX, 0, 0}, {Op::CMP, ABX, 4, 1}, {Op::DEC, ABX, 7, 0}, {Op::UNK, ABX, 0, 0},
+    /* 0xE0 */ {Op::CPX, IMM, 2, 0}, {Op::SBC, IIR, 6, 0}, {Op::UNK, IMM, 0, 0}, {Op::UNK, IIR, 0, 0}, {Op::CPX, ZP0, 3, 0}, {Op::SBC, ZP0, 3, 0}, {Op::INC, ZP0, 5, 0}, {Op::UNK, ZP0, 0, 0},
+    /* 0xE8 */ {Op::INX, IML, 2, 0}, {Op::SBC, IMM, 2, 0}, {Op::NOP, IML, 2, 0}, {Op::UNK, IMM, 0, 0}, {Op::CPX, ABS, 4, 0}, {Op::SBC, ABS, 4, 0}, {Op::INC, ABS, 6, 0}, {Op::UNK, ABS, 0, 0},
+    /* 0xF0 */ {Op::BEQ, REL, 2, 0}, {Op::SBC, IIX, 5, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, IIX, 0, 0}, {Op::UNK, ZPX, 0, 0}, {Op::SBC, ZPX, 4, 0}, {Op::INC, ZPX, 6, 0}, {Op::UNK, ZPX, 0, 0},
+    /* 0xF8 */ {Op::SED, IML, 2, 0}, {Op::SBC, ABY, 4, 1}, {Op::UNK, IML, 0, 0}, {Op::UNK, ABY, 0, 0}, {Op::UNK, ABX, 0, 0}, {Op::SBC, ABX, 4, 1}, {Op::INC, ABX, 7, 0}, {Op::UNK, ABX, 0, 0},
+}};
+
+template<std::size_t... Opcodes>
+constexpr std::array<CPU::OpcodeEntry, 256> CPU::makeOpcodeTable(std::index_sequence<Opcodes...>) {
+    return {{ OpcodeEntry{&makeInstruction<OpcodeDescriptions[Opcodes].addrMode, OpcodeDescriptions[Opcodes].cycles, OpcodeDescriptions[Opcodes].pageCrossCycles>,
+                          &CPU::executeOperation<OpcodeDescriptions[Opcodes].operation, OpcodeDescriptions[Opcodes].addrMode>,
+                          OpcodeDescriptions[Opcodes].addrMode, OpcodeDescriptions[Opcodes].cycles, instructionLength(OpcodeDescriptions[Opcodes].addrMode)}... }};
+}
+
+constexpr std::array<CPU::OpcodeEntry, 256> CPU::OpcodeTable = CPU::makeOpcodeTable(std::make_index_sequence<256>{});
+
 CPU::CPU(Memory &_memory, PPU& _ppu, EventQueue& _eventQueue, Logger* _logger)
-    : syncTimePoint{}, _registers{}, memory{_memory}, ppu{_ppu}, eventQueue{_eventQueue}, logger{_logger}, instructionCounter{0} {
+    : syncTimePoint{}, renderTimePoint{}, _registers{}, memory{_memory}, decodeCache{_memory.getMapper()}, ppu{_ppu}, eventQueue{_eventQueue}, logger{_logger}, instructionCounter{0}, nativeInstructionCounter{0}, blockTranslation{true}, jitEnabled{true}, throttling{true},
+      lagging{false}, frameskip{0}, autoFrameskip{false}, skippedFrames{0} {
     // initializing PC with address from Reset Vector
     registers().PC = memory.read16(ResetVectorAddress);
 }
@@ -121,354 +171,473 @@ void CPU::run() {
 void CPU::exec() {
     auto ppuFrameBefore = ppu.currentFrame();
     Instruction instruction = fetchInstruction();
+    _execInstruction(instruction, ppuFrameBefore);
+}
+
+/*
+    Block is executed instruction by instruction exactly as exec() does, but without fetching and dispatching.
+    Execution leaves the block if PC goes not where block expects(interrupt), if mapper switches banks or PRG-ROM is written,
+        or after frame change(so caller can do something between frames).
+*/
+void CPU::execBlock() {
+    Address start = registers().PC;
+    TranslatedBlock* block = nullptr;
+    if(blockTranslation) {
+        block = decodeCache.findBlock(start);
+        if(!block) block = translateBlock(start);
+    }
+    if(!block) {
+        exec();
+        return;
+    }
+    // idle loops are interpreted, so they can be fast-forwarded
+    if(jitEnabled && block->idleLoop == IdleLoop::None && _execNative(*block, start)) return;
+    u32 version = decodeCache.version();
+    u64 cyclesBefore = ppu.masterCycles();
+    Address expectedPC = start;
+    std::size_t count = block->instructions.size();
+    for(std::size_t i = 0; i < count; ++i) {
+        // block can be already removed from cache
+        if(registers().PC != expectedPC || decodeCache.version() != version) return;
+        const DecodedInstruction decoded = block->instructions[i];
+        const OpcodeEntry& entry = OpcodeTable[decoded.opcode];
+        expectedPC += entry.length;
+        auto ppuFrameBefore = ppu.currentFrame();
+        Instruction instruction = entry.decode(*this, registers().PC, decoded.opcode, decoded.operand);
+        if(_execInstruction(instruction, ppuFrameBefore)) return;
+    }
+    // idle loop has just made one iteration and is going to make another one(block is read only if it's still in cache)
+    if(decodeCache.version() == version && registers().PC == start && block->idleLoop != IdleLoop::None) {
+        _skipIdleLoop(*block, ppu.masterCycles() - cyclesBefore);
+    }
+}
+
+/*
+    Idle loop is fast-forwarded by whole iterations right before the next PPU event, which can be noticed by CPU(vblank/NMI or frame end).
+    Iterations would do the same thing every time, so after skipping everything happens on the same cycle as if they were executed.
+    iterationCycles - duration of the last iteration in master clock cycles.
+*/
+void CPU::_skipIdleLoop(const TranslatedBlock& block, u64 iterationCycles) {
+    if(!eventQueueEmpty() || iterationCycles == 0) return;
+    if(block.idleLoop == IdleLoop::StatusPolling) {
+        // PPUSTATUS read should return the same value on every skipped iteration
+        ppu.catchUp();
+        if(!ppu.statusStableUntilEvent()) return;
+    }
+    u64 now = ppu.masterCycles();
+    u64 nextEvent = ppu.nextEventCycles();
+    if(now >= nextEvent) return;
+    // last skipped instruction should end before the event
+    u64 iterations = (nextEvent - 1 - now) / iterationCycles;
+    // registers still keep PPUSTATUS value of the previous read, so last iteration of polling loop is executed as usual
+    if(block.idleLoop == IdleLoop::StatusPolling && iterations > 0) --iterations;
+    if(iterations == 0) return;
+    if(block.idleLoop == IdleLoop::Counter) {
+        Address counterAddress = block.instructions[0].operand;
+        u8 counter = memory.read8(counterAddress) + iterations;
+        memory.write8(counterAddress, counter);
+        registers().setNZ(counter);
+    }
+    ppu.addMasterCycles(iterations * iterationCycles);
+    instructionCounter += iterations * block.instructions.size();
+}
+
+bool CPU::_execInstruction(Instruction& instruction, u64 ppuFrameBefore) {
     u8 cyclesBefore = instruction.cycles - 1;
-    emulateCycles([this, &instruction]() { return instruction.cycles - 1;  }, false);
-    emulateCycles([this, &instruction, cyclesBefore]() { executeInstruction(instruction); return instruction.cycles - cyclesBefore; }, true);
-    auto ppuFrameAfter = ppu.currentFrame();
-    if(ppuFrameBefore != ppuFrameAfter) _frameSync();
+    // memory accesses of the instruction happen on its last cycle
+    emulateCycles(instruction.cycles - 1, false);
+    executeInstruction(instruction);
+    emulateCycles(instruction.cycles - cyclesBefore, true);
+    return _frameChanged(ppuFrameBefore);
+}
+
+bool CPU::_frameChanged(u64 ppuFrameBefore) {
+    if(ppu.currentFrame() == ppuFrameBefore) return false;
+    if(throttling) _frameSync();
+    _updateFrameskip();
+    return true;
 }
 
+/*
+    Runs native code of the block(compiling it on the first run), returns false if block has no native code.
+    Native code runs only if no event waits for the end of instruction(IRQ, masked by I flag, doesn't wait),
+        its instructions can't post events, and it stops when PPU should catch up. So after it everything is done
+        as after the last of its instructions in interpreter.
+    If it stops before instruction, which it can't execute, the instruction is executed by interpreter.
+*/
+bool CPU::_execNative(TranslatedBlock& block, Address start) {
+    if(eventQueue.oneShotPending() || (eventQueue.irqPending() && !registers().interruptDisable())) return false;
+    // the same PRG-ROM bytes can be mapped to other address after bank switching
+    if(block.nativeEpoch != jit.epoch() || block.nativeStart != start) {
+        std::vector<JITInstruction> instructions;
+        Address offset = start;
+        for(const DecodedInstruction& decoded : block.instructions) {
+            const OpcodeDescription& description = OpcodeDescriptions[decoded.opcode];
+            u8 length = OpcodeTable[decoded.opcode].length;
+            instructions.push_back(JITInstruction{description.operation, description.addrMode, description.cycles, description.pageCrossCycles,
+                                                  decoded.operand, offset, length});
+            offset += length;
+        }
+        block.native = jit.compile(instructions);
+        block.nativeStart = start;
+        block.nativeEpoch = jit.epoch();
+    }
+    if(!block.native) return false;
+    auto ppuFrameBefore = ppu.currentFrame();
+    u64 cyclesBefore = ppu.masterCycles();
+    JITContext context{&registers(), memory.get().data(), memory.readPageTable(), memory.writePageTable(), cyclesBefore, ppu.nextEventCycles(), 0};
+    bool stopped = block.native(&context);
+    ppu.addMasterCycles(context.clock - cyclesBefore);
+    instructionCounter += context.executed;
+    nativeInstructionCounter += context.executed;
+    if(stopped) exec();
+    else {
+        emulateCycles(0, true);
+        _frameChanged(ppuFrameBefore);
+    }
+    return true;
+}
+
+// PRG-ROM instructions are decoded once, then opcode and operand are taken from the decode cache
 Instruction CPU::fetchInstruction() {
     Address offset = registers().PC;
+    if(const DecodedInstruction* decoded = decodeCache.find(offset)) return OpcodeTable[decoded->opcode].decode(*this, offset, decoded->opcode, decoded->operand);
     u8 opcode = memory.read8(offset);
-    AddressationMode addrMode;
-    Instruction instruction;
+    const OpcodeEntry& entry = OpcodeTable[opcode];
+    u16 operand = 0;
+    if(entry.length == 2) operand = memory.read8(offset + 1);
+    else if(entry.length == 3) operand = memory.read16(offset + 1);
+    decodeCache.store(offset, opcode, operand, entry.length);
+    return entry.decode(*this, offset, opcode, operand);
+}
 
-    try {
-        addrMode = AddrModesByOpcode[opcode];
-        instruction = makeInstruction(*this, addrMode, offset, opcode);
-    }
-    catch (UnknownOpcodeException) {
-        if(logger) logger->log(LogLevel::Error, "CPU::step() - unknown opcode " + std::to_string(opcode));
-        throw UnknownOpcodeException{};
+// checks if block is one of idle loops, waiting for vblank or NMI
+IdleLoop detectIdleLoop(const TranslatedBlock& block, Address start) {
+    const auto& instructions = block.instructions;
+    if(instructions.size() == 1 && instructions[0].opcode == 0x4C && instructions[0].operand == start) {
+        return IdleLoop::JumpToSelf;
+    }
+    if(instructions.size() != 2) return IdleLoop::None;
+    const DecodedInstruction& first = instructions[0];
+    const DecodedInstruction& second = instructions[1];
+    // LDA, LDX, LDY or BIT $2002, then BPL to the first one(-5 bytes)
+    bool statusRead = (first.opcode == 0xAD || first.opcode == 0xAE || first.opcode == 0xAC || first.opcode == 0x2C) && first.operand == 0x2002;
+    if(statusRead && second.opcode == 0x10 && second.operand == 0xFB) return IdleLoop::StatusPolling;
+    // INC of RAM counter, then JMP to it
+    bool counterIncrement = (first.opcode == 0xE6 || first.opcode == 0xEE) && first.operand < 0x2000;
+    if(counterIncrement && second.opcode == 0x4C && second.operand == start) return IdleLoop::Counter;
+    return IdleLoop::None;
+}
+
+// block ends with control flow instruction
+constexpr bool endsBlock(Operation op) {
+    switch(op) {
+    case Operation::BCC: case Operation::BCS: case Operation::BEQ: case Operation::BMI:
+    case Operation::BNE: case Operation::BPL: case Operation::BVC: case Operation::BVS:
+    case Operation::JMP: case Operation::JSR: case Operation::RTS: case Operation::RTI: case Operation::BRK:
+        return true;
+    default:
+        return false;
     }
-    catch (UnknownAddressModeException) {
-        if(logger) logger->log(LogLevel::Error, "CPU::step() - unknown address mode " + std::to_string((int)addrMode));
-        throw UnknownOpcodeException{};
+}
+
+/*
+    Translates straight-line sequence of PRG-ROM instructions, starting at 'start', into block.
+    Block doesn't leave bank window of its first instruction, so it stays correct after bank switching.
+    Returns nullptr if instructions at 'start' can't be cached.
+*/
+TranslatedBlock* CPU::translateBlock(Address start) {
+    // code outside PRG-ROM isn't cached, and reading it can have side effects(PPU registers)
+    if(start < 0x8000) return nullptr;
+    TranslatedBlock block{};
+    Address offset = start;
+    while(block.instructions.size() < MaxBlockLength) {
+        const DecodedInstruction* decoded = decodeCache.find(offset);
+        if(!decoded) {
+            // PRG-ROM reading has no side effects
+            u8 opcode = memory.read8(offset);
+            u8 length = OpcodeTable[opcode].length;
+            u16 operand = 0;
+            if(length == 2) operand = memory.read8(offset + 1);
+            else if(length == 3) operand = memory.read16(offset + 1);
+            decodeCache.store(offset, opcode, operand, length);
+            decoded = decodeCache.find(offset);
+            if(!decoded) break;
+        }
+        block.instructions.push_back(*decoded);
+        offset += OpcodeTable[decoded->opcode].length;
+        if(endsBlock(OpcodeDescriptions[decoded->opcode].operation)) break;
+        if((offset / DecodeCache::DecodeWindowSize) != (start / DecodeCache::DecodeWindowSize)) break;
     }
-    return instruction;
+    block.idleLoop = detectIdleLoop(block, start);
+    return decodeCache.storeBlock(start, std::move(block));
 }
 
 // returns number of cycles instruction elapsed
 u8 CPU::executeInstruction(Instruction& instruction) {
     Registers& regs = registers();
-    u16 nextBranchAddress = 0;          // set by branching operation
-    u16 nextUnconditionalAddress = 0;   // set by any other operation
-    switch(instruction.opcode) {
-    // ADC
-    case 0x69: case 0x65: case 0x75: case 0x6D: case 0x7D: case 0x79: case 0x61: case 0x71: {
+    // by default going to the next instruction. Jumps, branches and interrupts override it
+    regs.PC += instruction.length;
+    (this->*OpcodeTable[instruction.opcode].execute)(instruction);
+    // IT SHOULD BE HERE: trying to not trigger unnecessary read operation
+#ifdef DEBUG
+    if(logger) logger->log(LogLevel::Debug, "[" + std::to_string(instructionCounter) + "][PC: " + numToHexStr(instruction.offset, 4) + "]:" + getPrettyInstruction(instruction.opcode, instruction.addrMode, instruction.offset, instruction));
+#endif
+    instructionCounter++;
+    return instruction.cycles;
+}
+
+/*
+    Executes one operation. Operation and addressation mode are known at compile time,
+    so each opcode from the OpcodeTable gets its own handler without any runtime dispatch.
+*/
+template<Operation Op, AddressationMode Mode>
+void CPU::executeOperation(Instruction& instruction) {
+    Registers& regs = registers();
+    if constexpr (Op == Operation::ADC) {
         u16 res = regs.A + instruction.val8() + regs.carry();
         // carry can be detected if result is smaller than the first term(as technically we summ only positive numbers)
         // overflow flag is set for a + b = c, if a and b have the same sign, and c has other
         // ~(regs.A ^ adding) will will evaluate to true, if both have same sign, and regs.A ^ res - if both have different signs
-        regs.setZero((res & 0xFF) == 0).setNegative(res).setCarry(res > 0xFF).setOverflow((~(regs.A ^ instruction.val8()))&(regs.A ^ res)&0x80);
+        regs.setNZ(res & 0xFF).setCarry(res > 0xFF).setOverflow((~(regs.A ^ instruction.val8()))&(regs.A ^ res)&0x80);
         regs.A = res & 0xFF;
-        break;
     }
-    // AND
-    case 0x29: case 0x25: case 0x35: case 0x2D: case 0x3D: case 0x39: case 0x21: case 0x31:
+    else if constexpr (Op == Operation::AND) {
         regs.A &= instruction.val8();
-        regs.setZero(regs.A).setNegative(regs.A);
-        break;
-    // ASL
-    case 0x0A: case 0x06: case 0x16: case 0x0E: case 0x1E: {
-        // accumulator
-        if (instruction.opcode == 0x0A) {
+        regs.setNZ(regs.A);
+    }
+    else if constexpr (Op == Operation::ASL) {
+        if constexpr (Mode == AddressationMode::Accumulator) {
             regs.setCarry(regs.A & 0b10000000);
             regs.A <<= 1;
-            regs.setZero(regs.A).setNegative(regs.A);
+            regs.setNZ(regs.A);
         }
         // memory
         else {
             regs.setCarry(instruction.val8() & 0b10000000);
             u8 res = instruction.val8() << 1;
             memory.write8(instruction.address, res);
-            regs.setZero(res).setNegative(res);
+            regs.setNZ(res);
         }
-        break;
-    }
-    // BCC
-    case 0x90: if(!regs.carry()) nextBranchAddress = instruction.address; break;
-    // BCS
-    case 0xB0: if(regs.carry()) nextBranchAddress = instruction.address; break;
-    // BEQ
-    case 0xF0: if(regs.zero()) nextBranchAddress = instruction.address; break;
-    // BIT
-    case 0x24: case 0x2C: {
+    }
+    else if constexpr (Op == Operation::BCC) branch(!regs.carry(), instruction);
+    else if constexpr (Op == Operation::BCS) branch(regs.carry(), instruction);
+    else if constexpr (Op == Operation::BEQ) branch(regs.zero(), instruction);
+    else if constexpr (Op == Operation::BIT) {
         u8 res = regs.A & instruction.val8();
-        // negative and overflow flags are set to value of MEMORY bits, zero - to result's
-        regs.setZero(res).setNegative(instruction.val8()).setOverflow(instruction.val8() & 0b01000000);
-        break;
-    }
-    // BMI
-    case 0x30: if(regs.negative()) nextBranchAddress = instruction.address; break;
-    // BNE
-    case 0xD0: if(!regs.zero()) nextBranchAddress = instruction.address; break;
-    // BPL
-    case 0x10: if(!regs.negative()) nextBranchAddress = instruction.address; break;
-    // BRK
-    case 0x00: {
-        interrupt(InterruptType::BRK, regs.PC + instruction.length);
-        nextUnconditionalAddress = InterruptVectorAddress;
-        break;
-    }
-    // BVC
-    case 0x50: if(!regs.overflow()) nextBranchAddress = instruction.address; break;
-    // BVS
-    case 0x70: if(regs.overflow()) nextBranchAddress = instruction.address; break;
-    // CLC
-    case 0x18: regs.setCarry(false); break;
-    // CLD
-    case 0xD8: regs.setDecimal(false); break;
-    // CLI
-    case 0x58: regs.setInterruptDisable(false); break;
-    // CLV
-    case 0xB8: regs.setOverflow(false); break;
-    // CMP
-    case 0xC9: case 0xC5: case 0xD5: case 0xCD: case 0xDD: case 0xD9: case 0xC1: case 0xD1: {
+        // negative and overflow flags are set to value of MEMORY bits, zero - to result's(memory bit 7 goes to bit 8 of nz)
+        regs.setNZ(res | ((instruction.val8() & 0b10000000) << 1)).setOverflow(instruction.val8() & 0b01000000);
+    }
+    else if constexpr (Op == Operation::BMI) branch(regs.negative(), instruction);
+    else if constexpr (Op == Operation::BNE) branch(!regs.zero(), instruction);
+    else if constexpr (Op == Operation::BPL) branch(!regs.negative(), instruction);
+    // BRK has padding byte after opcode, which is skipped on return
+    else if constexpr (Op == Operation::BRK) interrupt(InterruptType::BRK, regs.PC + 1);
+    else if constexpr (Op == Operation::BVC) branch(!regs.overflow(), instruction);
+    else if constexpr (Op == Operation::BVS) branch(regs.overflow(), instruction);
+    else if constexpr (Op == Operation::CLC) regs.setCarry(false);
+    else if constexpr (Op == Operation::CLD) regs.setDecimal(false);
+    else if constexpr (Op == Operation::CLI) regs.setInterruptDisable(false);
+    else if constexpr (Op == Operation::CLV) regs.setOverflow(false);
+    else if constexpr (Op == Operation::CMP) {
         u8 res = regs.A - instruction.val8();
-        regs.setCarry(regs.A >= instruction.val8()).setZero(regs.A == instruction.val8()).setNegative(res);
-        break;
+        regs.setCarry(regs.A >= instruction.val8()).setNZ(res);
     }
-    // CPX
-    case 0xE0: case 0xE4: case 0xEC: {
+    else if constexpr (Op == Operation::CPX) {
         u8 res = regs.X - instruction.val8();
-        regs.setCarry(regs.X >= instruction.val8()).setZero(regs.X == instruction.val8()).setNegative(res);
-        break;
+        regs.setCarry(regs.X >= instruction.val8()).setNZ(res);
     }
-    // CPY
-    case 0xC0: case 0xC4: case 0xCC: {
+    else if constexpr (Op == Operation::CPY) {
         u8 res = regs.Y - instruction.val8();
-        regs.setCarry(regs.Y >= instruction.val8()).setZero(regs.Y == instruction.val8()).setNegative(res);
-        break;
+        regs.setCarry(regs.Y >= instruction.val8()).setNZ(res);
     }
-    // DEC
-    case 0xC6: case 0xD6: case 0xCE: case 0xDE: {
+    else if constexpr (Op == Operation::DEC) {
         u8 res = instruction.val8() - 1;
-        regs.setZero(res).setNegative(res);
+        regs.setNZ(res);
         memory.write8(instruction.address, res);
-        break;
-    }
-    // DEX
-    case 0xCA: regs.X--; regs.setZero(regs.X).setNegative(regs.X); break;
-    // DEY
-    case 0x88: regs.Y--; regs.setZero(regs.Y).setNegative(regs.Y);  break;
-    // EOR
-    case 0x49: case 0x45: case 0x55: case 0x4D: case 0x5D: case 0x59: case 0x41: case 0x51:
+    }
+    else if constexpr (Op == Operation::DEX) { regs.X--; regs.setNZ(regs.X); }
+    else if constexpr (Op == Operation::DEY) { regs.Y--; regs.setNZ(regs.Y); }
+    else if constexpr (Op == Operation::EOR) {
         regs.A ^= instruction.val8();
-        regs.setZero(regs.A).setNegative(regs.A);
-        break;
-    // INC
-    case 0xE6: case 0xF6: case 0xEE: case 0xFE: {
+        regs.setNZ(regs.A);
+    }
+    else if constexpr (Op == Operation::INC) {
         u8 res = instruction.val8() + 1;
-        regs.setZero(res).setNegative(res);
+        regs.setNZ(res);
         memory.write8(instruction.address, res);
-        break;
-    }
-    // INX
-    case 0xE8: regs.X++; regs.setZero(regs.X).setNegative(regs.X); break;
-    // INY
-    case 0xC8: regs.Y++; regs.setZero(regs.Y).setNegative(regs.Y); break;
-    // JMP
-    case 0x4C: case 0x6C:
+    }
+    else if constexpr (Op == Operation::INX) { regs.X++; regs.setNZ(regs.X); }
+    else if constexpr (Op == Operation::INY) { regs.Y++; regs.setNZ(regs.Y); }
+    else if constexpr (Op == Operation::JMP) {
         // case of JMP indirect 6502 bug
-        if((instruction.opcode == 0x6C) && ((instruction.argument & 0xff) == 0xff)) {
-            instruction.address = (memory.read8(instruction.argument & 0xFF00) << 8) + memory.read8(instruction.argument);
+        if constexpr (Mode == AddressationMode::Indirect) {
+            if((instruction.argument & 0xff) == 0xff) {
+                instruction.address = (memory.read8(instruction.argument & 0xFF00) << 8) + memory.read8(instruction.argument);
+            }
         }
-        nextUnconditionalAddress = instruction.address;
-        break;
-    // JSR
-    case 0x20:
+        regs.PC = instruction.address;
+    }
+    else if constexpr (Op == Operation::JSR) {
         // push return address (minus one) on to the stack
         push((u16)(instruction.offset + instruction.length - 1));
-        nextUnconditionalAddress = instruction.address;
-        break;
-    // LDA
-    case 0xA9: case 0xA5: case 0xB5: case 0xAD: case 0xBD: case 0xB9: case 0xA1: case 0xB1:
+        regs.PC = instruction.address;
+    }
+    else if constexpr (Op == Operation::LDA) {
         regs.A = instruction.val8();
-        regs.setZero(regs.A).setNegative(regs.A);
-        break;
-    // LDX
-    case 0xA2: case 0xA6: case 0xB6: case 0xAE: case 0xBE:
+        regs.setNZ(regs.A);
+    }
+    else if constexpr (Op == Operation::LDX) {
         regs.X = instruction.val8();
-        regs.setZero(regs.X).setNegative(regs.X);
-        break;
-    // LDY
-    case 0xA0: case 0xA4: case 0xB4: case 0xAC: case 0xBC:
+        regs.setNZ(regs.X);
+    }
+    else if constexpr (Op == Operation::LDY) {
         regs.Y = instruction.val8();
-        regs.setZero(regs.Y).setNegative(regs.Y);
-        break;
-    // LSR
-    case 0x4A: case 0x46: case 0x56: case 0x4E: case 0x5E: {
-        // accumulator
-        if(instruction.opcode == 0x4A) {
+        regs.setNZ(regs.Y);
+    }
+    else if constexpr (Op == Operation::LSR) {
+        if constexpr (Mode == AddressationMode::Accumulator) {
             regs.setCarry(regs.A & 0b1);
             regs.A >>= 1;
-            regs.setZero(regs.A).setNegative(regs.A);
+            regs.setNZ(regs.A);
         }
         // memory
         else {
             u8 res = instruction.val8() >> 1;
             regs.setCarry(instruction.val8() & 0b1);
             memory.write8(instruction.address, res);
-            regs.setZero(res).setNegative(res);
+            regs.setNZ(res);
         }
-        break;
     }
-    // NOP
-    case 0xEA: break;
-    // ORA
-    case 0x09: case 0x05: case 0x15: case 0x0D: case 0x1D: case 0x19: case 0x01: case 0x11:
+    else if constexpr (Op == Operation::NOP) {}
+    else if constexpr (Op == Operation::ORA) {
         regs.A |= instruction.val8();
-        regs.setZero(regs.A).setNegative(regs.A);
-        break;
-    // PHA
-    case 0x48: push(regs.A); break;
-    // PHP
+        regs.setNZ(regs.A);
+    }
+    else if constexpr (Op == Operation::PHA) push(regs.A);
     // ??????????? SHOULD I SET B FLAG ??????????????????
-    case 0x08: regs.setBFlag(true); push(regs.P); break;
-    // PLA
-    case 0x68: regs.A = top8(); pop8(); regs.setZero(regs.A).setNegative(regs.A); break;
-    // PLP
-    case 0x28: regs.P = top8(); pop8(); break;
-    // ROL
-    case 0x2A: case 0x26: case 0x36: case 0x2E: case 0x3E: {
-        // accumulator
-        if (instruction.opcode == 0x2A) {
+    else if constexpr (Op == Operation::PHP) { regs.setBFlag(true); push(regs.status()); }
+    else if constexpr (Op == Operation::PLA) { regs.A = top8(); pop8(); regs.setNZ(regs.A); }
+    else if constexpr (Op == Operation::PLP) { regs.setStatus(top8()); pop8(); }
+    else if constexpr (Op == Operation::ROL) {
+        if constexpr (Mode == AddressationMode::Accumulator) {
             u8 res = (regs.A << 1) | regs.carry();
             regs.setCarry(regs.A & 0b10000000);
             regs.A = res;
-            regs.setZero(regs.A).setNegative(regs.A);
+            regs.setNZ(regs.A);
         }
         // memory
         else {
             u8 res = (instruction.val8() << 1) | regs.carry();
             regs.setCarry(instruction.val8() & 0b10000000);
             memory.write8(instruction.address, res);
-            regs.setZero(res).setNegative(res);
+            regs.setNZ(res);
         }
-        break;
     }
-    // ROR
-    case 0x6A: case 0x66: case 0x76: case 0x6E: case 0x7E: {
-        // accumulator
-        if(instruction.opcode == 0x6A) {
+    else if constexpr (Op == Operation::ROR) {
+        if constexpr (Mode == AddressationMode::Accumulator) {
             u8 res = (regs.A >> 1) | (regs.carry() << 7);
             regs.setCarry(regs.A & 1);
             regs.A = res;
-            regs.setZero(regs.A).setNegative(regs.A);
+            regs.setNZ(regs.A);
         }
         // memory
         else {
             u8 res = (instruction.val8() >> 1) | (regs.carry() << 7);
             regs.setCarry(instruction.val8() & 1);
             memory.write8(instruction.address, res);
-            regs.setZero(res).setNegative(res);
+            regs.setNZ(res);
         }
-        break;
-    }
-    // RTI
-    case 0x40: regs.P = top8(); pop8(); nextUnconditionalAddress = top16(); pop16(); break;
-    // RTS
-    case 0x60: nextUnconditionalAddress = top16() + 1; pop16(); break;
-    // SBC
-    case 0xE9: case 0xE5: case 0xF5: case 0xED: case 0xFD: case 0xF9: case 0xE1: case 0xF1: {
+    }
+    else if constexpr (Op == Operation::RTI) { regs.setStatus(top8()); pop8(); regs.PC = top16(); pop16(); }
+    else if constexpr (Op == Operation::RTS) { regs.PC = top16() + 1; pop16(); }
+    else if constexpr (Op == Operation::SBC) {
         u16 res = regs.A - instruction.val8() - !(regs.carry());
         // carry flag is CLEARED if carry occures
         // overflow flag is set the same way, as in ADC
-        regs.setZero((res & 0xFF) == 0).setNegative(res).setCarry(!(res & 0x100)).setOverflow((regs.A ^ res)&(~instruction.val8() ^ res)&0x80);
+        regs.setNZ(res & 0xFF).setCarry(!(res & 0x100)).setOverflow((regs.A ^ res)&(~instruction.val8() ^ res)&0x80);
         regs.A = res & 0xFF;
-        break;
-    }
-    // SEC
-    case 0x38: regs.setCarry(true); break;
-    // SED
-    case 0xF8: regs.setDecimal(true); break;
-    // SEI
-    case 0x78: regs.setInterruptDisable(true); break;
-    // STA
-    case 0x85: case 0x95: case 0x8D: case 0x9D: case 0x99: case 0x81: case 0x91:
-        memory.write8(instruction.address, regs.A);
-        break;
-    // STX
-    case 0x86: case 0x96: case 0x8E:
-        memory.write8(instruction.address, regs.X);
-        break;
-    // STY
-    case 0x84: case 0x94: case 0x8C:
-        memory.write8(instruction.address, regs.Y);
-        break;
-    // TAX
-    case 0xAA: regs.X = regs.A; regs.setZero(regs.X).setNegative(regs.X); break;
-    // TAY
-    case 0xA8: regs.Y = regs.A; regs.setZero(regs.Y).setNegative(regs.Y); break;
-    // TSX
-    case 0xBA: regs.X = regs.S; regs.setZero(regs.X).setNegative(regs.X); break;
-    // TXA
-    case 0x8A: regs.A = regs.X; regs.setZero(regs.A).setNegative(regs.A); break;
-    // TXS
-    case 0x9A: regs.S = regs.X; break;
-    // TYA
-    case 0x98: regs.A = regs.Y; regs.setZero(regs.A).setNegative(regs.A); break;
-    default:
+    }
+    else if constexpr (Op == Operation::SEC) regs.setCarry(true);
+    else if constexpr (Op == Operation::SED) regs.setDecimal(true);
+    else if constexpr (Op == Operation::SEI) regs.setInterruptDisable(true);
+    else if constexpr (Op == Operation::STA) memory.write8(instruction.address, regs.A);
+    else if constexpr (Op == Operation::STX) memory.write8(instruction.address, regs.X);
+    else if constexpr (Op == Operation::STY) memory.write8(instruction.address, regs.Y);
+    else if constexpr (Op == Operation::TAX) { regs.X = regs.A; regs.setNZ(regs.X); }
+    else if constexpr (Op == Operation::TAY) { regs.Y = regs.A; regs.setNZ(regs.Y); }
+    else if constexpr (Op == Operation::TSX) { regs.X = regs.S; regs.setNZ(regs.X); }
+    else if constexpr (Op == Operation::TXA) { regs.A = regs.X; regs.setNZ(regs.A); }
+    else if constexpr (Op == Operation::TXS) regs.S = regs.X;
+    else if constexpr (Op == Operation::TYA) { regs.A = regs.Y; regs.setNZ(regs.A); }
+    else {
         // unknown opcode is considered to be NOP
         if(logger) logger->log(LogLevel::Warning, "Unknown opcode " + std::to_string(instruction.opcode) + ". Can it be NOP?");
-        instruction.cycles = 2; break;
+        instruction.cycles = 2;
     }
-    // IT SHOULD BE HERE: trying to not trigger unnecessary read operation
-#ifdef DEBUG
-    if(logger) logger->log(LogLevel::Debug, "[" + std::to_string(instructionCounter) + "][PC: " + numToHexStr(regs.PC, 4) + "]:" + getPrettyInstruction(instruction.opcode, instruction.addrMode, instruction.offset, instruction));
-#endif
-    if (nextUnconditionalAddress) regs.PC = nextUnconditionalAddress;
-    else if (nextBranchAddress) {
-        regs.PC = nextBranchAddress;
-        // add 1 to cycles if nextBranchAddress
-        ++instruction.cycles;
-        // if this page != nextBranchAddressPage add one more(page crossing)
-        if((instruction.offset & 255) != (nextBranchAddress & 255)) ++instruction.cycles;
-    }
-    else regs.PC += instruction.length;
-    instructionCounter++;
-    return instruction.cycles;
+}
+
+void CPU::branch(bool condition, Instruction& instruction) {
+    if(!condition) return;
+    registers().PC = instruction.address;
+    // add 1 to cycles if branch is taken
+    ++instruction.cycles;
+    // if this page != nextBranchAddressPage add one more(page crossing)
+    if((instruction.offset & 255) != (instruction.address & 255)) ++instruction.cycles;
 }
 
 Serialization::BytesCount CPU::serialize(std::string &buf) {
     u64 syncTimePointNum = std::chrono::time_point_cast<std::chrono::nanoseconds>(syncTimePoint).time_since_epoch().count();
     auto& regs = registers();
-    return Serialization::Serializer::serializeAll(buf, &syncTimePointNum, &regs.A, &regs.X, &regs.Y, &regs.PC, &regs.S, &regs.P,
+    u8 status = regs.status();
+    return Serialization::Serializer::serializeAll(buf, &syncTimePointNum, &regs.A, &regs.X, &regs.Y, &regs.PC, &regs.S, &status,
                                                    &memory.get(), &instructionCounter);
 }
 
 Serialization::BytesCount CPU::deserialize(const std::string &buf, Serialization::BytesCount offset) {
     auto& regs = registers();
     u64 syncTimePointNum;
+    u8 status;
     auto memWr = wrapArr(memory.get());
-    auto res = Serialization::Deserializer::deserializeAll(buf, offset, &syncTimePointNum, &regs.A, &regs.X, &regs.Y, &regs.PC, &regs.S, &regs.P,
+    auto res = Serialization::Deserializer::deserializeAll(buf, offset, &syncTimePointNum, &regs.A, &regs.X, &regs.Y, &regs.PC, &regs.S, &status,
                                                    &memWr, &instructionCounter);
+    regs.setStatus(status);
     syncTimePoint = std::chrono::time_point<std::chrono::high_resolution_clock, std::chrono::nanoseconds>(std::chrono::nanoseconds(syncTimePointNum));
     return res;
 }
 
+void CPU::saveState(CPUState& state) const {
+    state.registers = _registers;
+    state.instructionCounter = instructionCounter;
+    std::copy(memory.get().begin(), memory.get().begin() + state.memory.size(), state.memory.begin());
+}
+
+void CPU::loadState(const CPUState& state) {
+    _registers = state.registers;
+    instructionCounter = state.instructionCounter;
+    std::copy(state.memory.begin(), state.memory.end(), memory.get().begin());
+}
+
 /*
-    Accepts function f, that accepts 0 args and returns the number of cycles it took to emulate it.
-    It should execute approximately the time of cycle * f return value;
+    Advances master clock by the number of CPU cycles.
+    PPU is not stepped here: it catches up lazily when CPU accesses it or when some PPU event is due(see PPU::catchUp).
 */
-void CPU::emulateCycles(std::function<int(void)> f, bool processEvents) {
-    int cycles = f();
+void CPU::emulateCycles(int cycles, bool processEvents) {
     // PPU works on 3*CPUFrequency
-    for(int i = 0; i < cycles * 3; ++i) {
-        ppu.emulateCycle();
+    if(cycles > 0) ppu.addMasterCycles(cycles * 3);
+    if(processEvents) {
+        if(ppu.syncNeeded()) ppu.catchUp();
+        if(!eventQueueEmpty()) _processEventQueue();
     }
-    if(processEvents && !eventQueueEmpty()) _processEventQueue();
 }
 
 void CPU::interrupt(InterruptType intType, Address nextPC) {
-    // NMI should be processed
-    if(registers().interruptDisable() && intType != InterruptType::NMI) return;
+    // only IRQ can be masked, NMI and BRK are always processed
+    if(registers().interruptDisable() && intType == InterruptType::IRQ) return;
     registers().setBFlag(intType == InterruptType::BRK);    // only BRK sets B flag
-    push((u16)nextPC).push(registers().P);
+    push((u16)nextPC).push(registers().status());
     registers().setInterruptDisable(true);
-    registers().PC = intType == InterruptType::NMI ? memory.read16(NonMaskableInterruptVectorAddress) : memory.read8(InterruptVectorAddress);
+    registers().PC = intType == InterruptType::NMI ? memory.read16(NonMaskableInterruptVectorAddress) : memory.read16(InterruptVectorAddress);
 }
 
 // using a frame as syncrhronization unit
@@ -476,54 +645,70 @@ void CPU::_frameSync() {
     static const u32 MaxFrameDurationNs = 1000000000 / 60;
     auto curTimePoint = std::chrono::high_resolution_clock::now();
     auto sleepDuration = std::chrono::nanoseconds(MaxFrameDurationNs - (curTimePoint - syncTimePoint).count());
+    // frame took longer, than it should
+    lagging = sleepDuration.count() < 0;
     std::this_thread::sleep_for(std::chrono::nanoseconds(sleepDuration));
     syncTimePoint = std::chrono::high_resolution_clock::now();
 }
 
+// decides if the next frame should be drawn
+void CPU::_updateFrameskip() {
+    bool render;
+    if(autoFrameskip) {
+        // throttled frames come every 1/60 s, so a bit smaller interval is used to not skip them because of timer jitter
+        static const auto MinRenderInterval = std::chrono::nanoseconds(1000000000 / 80);
+        auto curTimePoint = std::chrono::high_resolution_clock::now();
+        render = (!(throttling && lagging) && curTimePoint - renderTimePoint >= MinRenderInterval) || skippedFrames + 1 >= MaxAutoFrameskip;
+        if(render) renderTimePoint = curTimePoint;
+    }
+    else render = skippedFrames >= frameskip;
+    skippedFrames = render ? 0 : skippedFrames + 1;
+    ppu.setFrameRendering(render);
+}
+
 void CPU::_processEventQueue() {
-    auto& events = eventQueue.get();
-    while(!events.empty()) {
-        EventType eventType = events.front();
-        events.pop();
+    while(eventQueue.oneShotPending()) {
+        EventType eventType = eventQueue.popOneShot();
         switch(eventType) {
-        case EventType::InterruptNMI: interrupt(InterruptType::NMI, registers().PC); break;
         case EventType::OAMDMAWrite: oamDmaWrite(); break;
+        case EventType::InterruptNMI: interrupt(InterruptType::NMI, registers().PC); break;
         default: {
             if(logger) logger->log(LogLevel::Error, "CPU::_processEventQueue(): unknown CPU event type " + std::to_string((int)eventType));
             throw UnknownCPUEventException{};
         }
         }
     }
+    // IRQ line stays pending until its source releases it
+    if(eventQueue.irqPending() && !registers().interruptDisable()) interrupt(InterruptType::IRQ, registers().PC);
 }
 
 /*
-    Sequentially writes 256 bytes of data from CPU page $XX00-$XXFF to the internal PPU's OAM memory.
-    It should take exactly 512 CPU cycles.
+    Writes 256 bytes of data from CPU page $XX00-$XXFF to the internal PPU's OAM memory.
+    It takes 513 CPU cycles(+1 if it starts on odd cycle): CPU is halted for one(or two) cycles, then it alternates reading and writing.
+    Plain memory pages(RAM, PRG-RAM, PRG-ROM) are copied at once, and PPU catches up with all DMA cycles in one batch.
 */
 void CPU::oamDmaWrite() {
-    // I hope that nothing bad will happen if I read from OAMDMA
+    // OAM and OAMADDR are used by PPU, so it should catch up with CPU first
+    ppu.catchUp();
     u8 page = ppu.accessPPURegisters().readOamdma();
     auto& OAM = ppu.getOAM();
     u8 startOAMAddr = ppu.accessPPURegisters().readOamaddr();
+    u32 cycles = OAMDMACycles + (ppu.masterCycles() / 3) % 2;
+    const u8* source = memory.readPage(page).data;
     for(int i = 0; i < 0x100; ++i) {
-        Address addr = (page << 8) + i;
         // this will make address cyclic(256 bytes)
         u8 oamAddr = startOAMAddr + i;
-        u8 val = 0;
-        emulateCycles([this, &val, addr] {
-            val = memory.read8(addr);
-            return 1;
-        }, false);
-        emulateCycles([this, &OAM, i, startOAMAddr, oamAddr, val]() {
-            OAM[oamAddr] = val;
+        // registers reading can have side effects, so it goes through memory
+        OAM[oamAddr] = source ? source[i] : memory.read8((page << 8) + i);
+    }
 #ifdef DEBUG
-            if (logger) logger->log(LogLevel::Debug, "[OAMDMA][" + std::to_string(instructionCounter) + "]: write of " + std::to_string(val) + " to OAM[" + std::to_string(oamAddr) + "]");
+    if (logger) logger->log(LogLevel::Debug, "[OAMDMA][" + std::to_string(instructionCounter) + "]: page " + std::to_string(page) + " to OAM[" + std::to_string(startOAMAddr) + "]");
 #endif
-            // each such operation consumes 2 CPU cycles
-            ++instructionCounter;
-            return 1;
-        }, true);
-    }
+    // each byte write is counted as instruction
+    instructionCounter += 0x100;
+    // events, caused by DMA cycles(NMI), are processed by the caller
+    emulateCycles(cycles, false);
+    if(ppu.syncNeeded()) ppu.catchUp();
 }
 
 std::string getPrettyInstruction(u8 opcode, AddressationMode addrMode, Address curAddress, Instruction instruction) {
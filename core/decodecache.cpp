@@ -0,0 +1,43 @@
+#include "include/decodecache.hpp"
+#include <algorithm>
+
+// entries are created with generation 0, so cache starts with generation 1 to make them invalid
+DecodeCache::DecodeCache(MapperInterface& _mapper)
+    : mapper{_mapper}, entries(_mapper.prgSize()), pages{}, blocks{}, generation{1}, _version{0} {
+    _mapPages();
+    mapper.attach(this);
+}
+
+DecodeCache::~DecodeCache() {
+    mapper.detach(this);
+}
+
+TranslatedBlock* DecodeCache::storeBlock(Address address, TranslatedBlock&& block) {
+    if(address < 0x8000 || block.instructions.empty() || blocks.size() >= 0xFFFF) return nullptr;
+    DecodedInstruction& entry = pages[(address >> 8) & 0x7F][address & 0xFF];
+    if(entry.generation != generation) return nullptr;
+    blocks.push_back(std::move(block));
+    entry.block = blocks.size();
+    return &blocks.back();
+}
+
+void DecodeCache::update(MapperInterface*, int eventType) {
+    if(eventType == (int)MapperEvent::PRGBanksSwitched) _mapPages();
+    else if(eventType == (int)MapperEvent::PRGROMWritten) _invalidate();
+    else return;
+    ++_version;
+}
+
+void DecodeCache::_mapPages() {
+    for(int page = 0; page < 0x80; ++page) pages[page] = &entries[mapper.prgOffset(0x8000 + (page << 8))];
+}
+
+void DecodeCache::_invalidate() {
+    ++generation;
+    blocks.clear();
+    // on overflow old entries can become valid again, so they should be cleared
+    if(generation == 0) {
+        std::fill(entries.begin(), entries.end(), DecodedInstruction{0, 0, 0, 0});
+        generation = 1;
+    }
+}
@@ -0,0 +1,47 @@
+#include "include/frameconverter.hpp"
+#include "include/ppumemory.hpp"
+
+FrameConverter::FrameConverter(PixelFormat _format)
+    : pixelFormat{_format}, lut{} {
+    for(u32 i = 0; i < lut.size(); ++i) {
+        u32 rgb = Palette[i & 0x3F];
+        u8 emphasis = i >> 6;
+        u32 r = (rgb >> 16) & 0xFF, g = (rgb >> 8) & 0xFF, b = rgb & 0xFF;
+        // each emphasis bit darkens other channels
+        if(emphasis & 0b110) r = r * EmphasisAttenuation / 256;
+        if(emphasis & 0b101) g = g * EmphasisAttenuation / 256;
+        if(emphasis & 0b011) b = b * EmphasisAttenuation / 256;
+        switch(pixelFormat) {
+        case PixelFormat::RGB888: lut[i] = (r << 16) | (g << 8) | b; break;
+        case PixelFormat::ARGB8888: lut[i] = 0xFF000000 | (r << 16) | (g << 8) | b; break;
+        case PixelFormat::RGB565: lut[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3); break;
+        }
+    }
+}
+
+void FrameConverter::convert(const Frame& frame, void* out) const {
+    if(pixelFormat == PixelFormat::RGB565) {
+        u16* pixels = static_cast<u16*>(out);
+        for(std::size_t i = 0; i < frame.size(); ++i) pixels[i] = lut[frame[i] & 0x1FF];
+    }
+    else {
+        u32* pixels = static_cast<u32*>(out);
+        for(std::size_t i = 0; i < frame.size(); ++i) pixels[i] = lut[frame[i] & 0x1FF];
+    }
+}
+
+void FrameConverter::convert(const Frame& frame, void* out, std::size_t pitch) const {
+    const std::size_t width = 256;
+    const u16* src = frame.data();
+    u8* line = static_cast<u8*>(out);
+    for(std::size_t y = 0; y < frame.size() / width; ++y, src += width, line += pitch) {
+        if(pixelFormat == PixelFormat::RGB565) {
+            u16* pixels = reinterpret_cast<u16*>(line);
+            for(std::size_t x = 0; x < width; ++x) pixels[x] = lut[src[x] & 0x1FF];
+        }
+        else {
+            u32* pixels = reinterpret_cast<u32*>(line);
+            for(std::size_t x = 0; x < width; ++x) pixels[x] = lut[src[x] & 0x1FF];
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <vector>
+#include "common.hpp"
+#include "mappers/mapperinterface.hpp"
+#include "observer/observer.hpp"
+
+// byte of pattern table plane and the same byte with reversed bits(for horizontally flipped sprites)
+struct PatternByte {
+    u8 plane;
+    u8 flipped;
+};
+
+/*
+    PPU reads pattern tables(CHR) on every tile and sprite fetch, so they are copied here and read without mapper calls.
+    Flipped planes are precomputed, so sprites don't reverse their bytes while rendering.
+    Entries are indexed by offset in CHR(not by PPU address), so bank switching only remaps cache pages.
+    CHR writes(CHR-RAM) refresh written entry.
+*/
+class CHRCache : public Observer<MapperInterface> {
+public:
+    CHRCache(MapperInterface& _mapper);
+    ~CHRCache();
+    // address should be < 0x2000
+    inline const PatternByte& get(Address address) const { return pages[(address >> 10) & 0b111][address & (PageSize - 1)]; }
+    // reloads entry after writing to CHR
+    void refresh(Address address);
+    void update(MapperInterface*, int eventType);
+
+    // the smallest CHR bank size of supported mappers
+    static const Address PageSize = 0x400;
+private:
+    void _mapPages();
+    void _load();
+
+    MapperInterface& mapper;
+    std::vector<PatternByte> entries;
+    // pages of PPU addresses $0000-$1FFF
+    std::array<PatternByte*, 8> pages;
+};
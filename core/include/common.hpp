@@ -32,7 +32,7 @@ const int PAGE_SIZE = 0x100;
 const int PRG_BANK_SIZE = 0x4000;
 const int CHR_BANK_SIZE = 0x1000;
 
-const std::vector<u8> SupportedMappers{0,1};
+const std::vector<u8> SupportedMappers{0,1,4};
 
 enum class AddressationMode {
     Implied,
@@ -65,26 +65,6 @@ const AddressationMode IND = AddressationMode::Indirect;
 const AddressationMode IIR = AddressationMode::IndexedIndirect;
 const AddressationMode IIX = AddressationMode::IndirectIndexed;
 
-const std::array<AddressationMode, 256> AddrModesByOpcode = {
-    IML, IIR, IML, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, ABS, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPX, ZPX, IML, ABY, IML, ABY, ABX, ABX, ABX, ABX,
-    ABS, IIR, IML, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, ABS, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPX, ZPX, IML, ABY, IML, ABY, ABX, ABX, ABX, ABX,
-    IML, IIR, IML, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, ABS, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPX, ZPX, IML, ABY, IML, ABY, ABX, ABX, ABX, ABX,
-    IML, IIR, IML, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, IND, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPX, ZPX, IML, ABY, IML, ABY, ABX, ABX, ABX, ABX,
-    IMM, IIR, IMM, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, ABS, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPY, ZPY, IML, ABY, IML, ABY, ABX, ABX, ABY, ABY,
-    IMM, IIR, IMM, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, ABS, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPY, ZPY, IML, ABY, IML, ABY, ABX, ABX, ABY, ABY,
-    IMM, IIR, IMM, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, ABS, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPX, ZPX, IML, ABY, IML, ABY, ABX, ABX, ABX, ABX,
-    IMM, IIR, IMM, IIR, ZP0, ZP0, ZP0, ZP0, IML, IMM, IML, IMM, ABS, ABS, ABS, ABS, REL, IIX, IML, IIX, ZPX, ZPX, ZPX, ZPX, IML, ABY, IML, ABY, ABX, ABX, ABX, ABX,
-};
-
-const std::array<u8, 256> CyclesByOpcode = {7, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                                            6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                                            6, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                                            6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                                            0, 6, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0, 2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0,
-                                            2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0, 2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
-                                            2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                                            2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0};
-
 enum class InterruptType {
     BRK,
     NMI,
@@ -0,0 +1,27 @@
+#pragma once
+#include "common.hpp"
+
+/*
+    Final composition of the scanline. PPU draws background and sprites as NES palette indices,
+    and resolves sprite priority while drawing(it depends on the order of sprites), so here every pixel just takes
+    sprite color where sprite wins(mask is 0xFF) or background color otherwise.
+    Result is frame pixel: palette index(masked with colorMask, greyscale uses 0x30) with emphasis bits above it(see framequeue.hpp).
+    Vectorized versions are used when CPU supports them. Scalar version is the reference one.
+*/
+namespace Compositor {
+    const std::size_t ScanlineWidth = 256;
+    using ComposeFunction = void (*)(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out);
+
+    void composeScalar(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out);
+#if defined(__x86_64__) || defined(__i386__)
+    void composeSSE2(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out);
+    void composeAVX2(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out);
+#endif
+    // the fastest version, supported by CPU
+    ComposeFunction best();
+
+    inline void compose(const u8* bckg, const u8* sprites, const u8* spritesMask, u8 colorMask, u16 emphasis, u16* out) {
+        static const ComposeFunction composeBest = best();
+        composeBest(bckg, sprites, spritesMask, colorMask, emphasis, out);
+    }
+}
@@ -6,21 +6,26 @@
 #include <queue>
 #include <chrono>
 #include <thread>
-#include <functional>
+#include <utility>
 #include "common.hpp"
 #include "memory.hpp"
 #include "ppu.hpp"
+#include "decodecache.hpp"
+#include "jit.hpp"
 #include "eventqueue.hpp"
 #include "log/log.hpp"
 #include "serialize/serializer.hpp"
 
+struct CPUState;
+
 class UnknownOpcodeException {};
-class UnknownAddressModeException {};
 class UnknownCPUEventException {};
 
 const Address ResetVectorAddress = 0xFFFC;
 const Address InterruptVectorAddress = 0xFFFE;
 const Address NonMaskableInterruptVectorAddress = 0xFFFA;
+// OAM DMA duration without odd cycle alignment
+const u32 OAMDMACycles = 513;
 const std::chrono::duration CPUCycle = std::chrono::nanoseconds(558);   // roughly
 
 struct Registers {
@@ -32,31 +37,55 @@ struct Registers {
     u8 Y;       // multi-purpose
     u16 PC;     // program counter
     u8 S;       // stack
-    u8 P;       // status
-
-    inline bool carry() const { return P & 1; }
-    inline bool zero() const { return P & 2; }
-    inline bool interruptDisable() const { return P & 4; }
-    inline bool decimal() const { return P & 8; }
-    inline bool bFlag() const { return P & 16; }
-    inline bool overflow() const { return P & 64; }
-    inline bool negative() const { return P & 128; }
-
-    inline Registers& setCarry(bool val) { P = val ? P | 0b00000001 : P & 0b11111110;  return *this; }
-    template<typename T>
-    inline Registers& setZero(T val) { P = val == 0 ? P | 0b00000010 : P & 0b11111101;  return *this; }
-    inline Registers& setZero(bool val) { P = val ? P | 0b00000010 : P & 0b11111101;  return *this; }
-    inline Registers& setInterruptDisable(bool val) { P = val ? P | 0b00000100 : P & 0b11111011;  return *this; }
-    inline Registers& setDecimal(bool val) { P = val ? P | 0b00001000 : P & 0b11110111;  return *this; }
+
+    /*
+        Status register is evaluated lazily: almost every operation changes N and Z, but they are rarely read before being overwritten.
+        So only the result of the last such operation is stored, and flags are computed from it when needed:
+            Z is set if low byte of nz is 0, N - if bit 7 or bit 8 of nz is set(bit 8 is used by BIT, which takes N from memory, not from result).
+        C and V are stored eagerly as separate bytes: they are set by fewer operations, and ADC/SBC/shifts/branches read C
+        right after it is set, so keeping the operands to recompute them would cost more than storing the result.
+        flags - other bits of P(I, D, B).
+        Full P value can be got with status() and set with setStatus().
+    */
+    u16 nz;
+    u8 c;
+    u8 v;
+    u8 flags;
+
+    inline bool carry() const { return c; }
+    inline bool zero() const { return !(nz & 0xFF); }
+    inline bool interruptDisable() const { return flags & 4; }
+    inline bool decimal() const { return flags & 8; }
+    inline bool bFlag() const { return flags & 16; }
+    inline bool overflow() const { return v; }
+    inline bool negative() const { return nz & 0x180; }
+
+    inline u8 status() const { return flags | c | (zero() << 1) | (v << 6) | (negative() << 7); }
+    inline Registers& setStatus(u8 val) {
+        flags = val & 0b00111100;
+        c = val & 1;
+        v = (val >> 6) & 1;
+        nz = ((val & 0b10000000) << 1) | !(val & 0b00000010);
+        return *this;
+    }
+    // sets Z and N flags from the result of operation
+    inline Registers& setNZ(u16 result) { nz = result; return *this; }
+    inline Registers& setCarry(bool val) { c = val; return *this; }
+    inline Registers& setInterruptDisable(bool val) { flags = val ? flags | 0b00000100 : flags & 0b11111011;  return *this; }
+    inline Registers& setDecimal(bool val) { flags = val ? flags | 0b00001000 : flags & 0b11110111;  return *this; }
     // b flag is used by some instructions when pushing/pulling flag register to/from stack
-    inline Registers& setBFlag(bool val) { P = val ? P | 0b00100000 : P & 0b11011111; return *this; }
-    inline Registers& setOverflow(bool val) { P = val ? P | 0b01000000 : P & 0b10111111;  return *this; }
-    template<typename T>
-    inline Registers& setNegative(T val) { P = val & 0b10000000 ? P | 0b10000000 : P & 0b01111111;  return *this; }
-    inline Registers& setNegative(bool val) { P = val ? P | 0b10000000 : P & 0b01111111;  return *this; }
+    inline Registers& setBFlag(bool val) { flags = val ? flags | 0b00100000 : flags & 0b11011111; return *this; }
+    inline Registers& setOverflow(bool val) { v = val; return *this; }
 };
 
 
+// instruction mnemonics(UNK is for unofficial opcodes, they are executed as NOPs)
+enum class Operation {
+    ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC, CLD, CLI, CLV, CMP, CPX, CPY,
+    DEC, DEX, DEY, EOR, INC, INX, INY, JMP, JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP,
+    ROL, ROR, RTI, RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA, UNK
+};
+
 class Instruction {
 public:
     Instruction() {}
@@ -79,26 +108,70 @@ private:
 
 class CPU : public Serialization::Serializable, public Serialization::Deserializable {
 public:
+    /*
+        Entry of the opcode dispatch table.
+        Table is generated at compile time, so addressation mode, cycles count and operation are baked into decode and execute handlers.
+    */
+    struct OpcodeEntry {
+        Instruction (*decode)(CPU& cpu, Address offset, u8 opcode, u16 operand);
+        void (CPU::*execute)(Instruction& instruction);
+        AddressationMode addrMode;
+        u8 cycles;
+        u8 length;
+    };
+
     CPU(Memory& _memory, PPU& _ppu, EventQueue& _eventQueue, Logger* _logger=nullptr);
     inline Memory& getMemory() { return memory; }
     inline Registers& registers() { return _registers; }
-    inline bool eventQueueEmpty() const { return eventQueue.get().empty(); }
+    inline bool eventQueueEmpty() const { return eventQueue.empty(); }
     inline auto getInstructionCounter() const { return instructionCounter; }
+    // instructions, executed by native code of blocks
+    inline auto getNativeInstructionCounter() const { return nativeInstructionCounter; }
     void run();
     // with all synchonizations
     void exec();
+    // executes translated block of instructions(or one instruction, if block can't be translated)
+    void execBlock();
+    inline void setBlockTranslation(bool enabled) { blockTranslation = enabled; }
+    // blocks are compiled to native code if JIT is available(see JIT), else or if it's disabled they are interpreted
+    inline void setJIT(bool enabled) { jitEnabled = enabled; }
+    inline bool jitAvailable() const { return jit.available(); }
+    // if throttling is disabled, CPU doesn't wait for the next frame time and runs as fast as it can
+    inline void setThrottling(bool enabled) { throttling = enabled; }
+    /*
+        Frameskip: skipped frames are fully emulated, but PPU doesn't draw them(see PPU::setFrameRendering).
+        Fixed frameskip draws one frame out of frames + 1.
+        Auto frameskip draws no more frames than display can show, and skips frames when throttled emulation lags behind real time.
+    */
+    inline void setFrameskip(u32 frames) { frameskip = frames; }
+    inline void setAutoFrameskip(bool enabled) { autoFrameskip = enabled; }
     inline std::thread runInSeparateThread() { return std::thread([this] { run(); }); }
 
     // serialization
     Serialization::BytesCount serialize(std::string &buf);
     Serialization::BytesCount deserialize(const std::string &buf, Serialization::BytesCount offset);
+    // snapshot(see Snapshot)
+    void saveState(CPUState& state) const;
+    void loadState(const CPUState& state);
 
 private:
     Instruction fetchInstruction();
     u8 executeInstruction(Instruction& instruction);
+    // executes fetched instruction with all synchronizations, returns true if frame has been changed
+    bool _execInstruction(Instruction& instruction, u64 ppuFrameBefore);
+    // returns true if frame has been changed since ppuFrameBefore(then waits for the frame time and updates frameskip)
+    bool _frameChanged(u64 ppuFrameBefore);
+    TranslatedBlock* translateBlock(Address start);
+    bool _execNative(TranslatedBlock& block, Address start);
+    void _skipIdleLoop(const TranslatedBlock& block, u64 iterationCycles);
+    template<Operation Op, AddressationMode Mode>
+    void executeOperation(Instruction& instruction);
+    void branch(bool condition, Instruction& instruction);
+    template<std::size_t... Opcodes>
+    static constexpr std::array<OpcodeEntry, 256> makeOpcodeTable(std::index_sequence<Opcodes...>);
 
     void interrupt(InterruptType, Address nextPC);
-    void emulateCycles(std::function<int(void)> f, bool processEvents);
+    void emulateCycles(int cycles, bool processEvents);
     void oamDmaWrite();
     // stack operations
     inline CPU& push(u8 val) { memory.write8((0x100 + registers().S), val); registers().S -= 1; return *this; }
@@ -108,21 +181,36 @@ private:
     u8 top8() { return memory.read8(0x100 + registers().S + 1); }
     u16 top16() { return memory.read16(0x100 + registers().S + 1); }
     void _frameSync();
+    void _updateFrameskip();
     void _processEventQueue();
 
+    static const std::array<OpcodeEntry, 256> OpcodeTable;
+
     const Address ROMOffset = 0xC000;
+    static const std::size_t MaxBlockLength = 32;
+    // auto frameskip draws at least one frame out of this count
+    static const u32 MaxAutoFrameskip = 8;
     std::chrono::time_point<std::chrono::high_resolution_clock, std::chrono::nanoseconds> syncTimePoint;
+    std::chrono::time_point<std::chrono::high_resolution_clock, std::chrono::nanoseconds> renderTimePoint;
     Registers _registers;
     Memory& memory;
+    DecodeCache decodeCache;
+    JIT jit;
     PPU& ppu;
     // different parts of NES can initialize different kinds of events: interrputs, OAMDMA write etc. Those events are added in the eventQueue
-    // and processed after competion of current CPU instruction in FIFO order.
+    // and processed after competion of current CPU instruction in priority order.
     EventQueue& eventQueue;
     Logger* logger;
     // used for debugging
     u64 instructionCounter;
+    u64 nativeInstructionCounter;
+    bool blockTranslation;
+    bool jitEnabled;
+    bool throttling;
+    bool lagging;
+    u32 frameskip;
+    bool autoFrameskip;
+    u32 skippedFrames;
 };
 
-Instruction makeInstruction(CPU& cpu, AddressationMode addrMode, Address offset, u8 opcode);
-
 std::string getPrettyInstruction(u8 opcode, AddressationMode addrMode, Address curAddress, Instruction instruction);
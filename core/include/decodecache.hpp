@@ -0,0 +1,84 @@
+#pragma once
+#include <array>
+#include <vector>
+#include "common.hpp"
+#include "jit.hpp"
+#include "mappers/mapperinterface.hpp"
+#include "observer/observer.hpp"
+
+// opcode and raw operand of instruction, stored in PRG-ROM
+struct DecodedInstruction {
+    u16 operand;
+    u8 opcode;
+    u16 generation;     // entry is valid only if it matches generation of the cache
+    u16 block;          // index + 1 of translated block, starting with this instruction(0 - no block)
+};
+
+/*
+    Loops, which only wait for the next PPU event(vblank or NMI), and can be fast-forwarded:
+        JumpToSelf:     JMP self
+        StatusPolling:  LDA/LDX/LDY/BIT $2002; BPL back
+        Counter:        INC counter; JMP back
+*/
+enum class IdleLoop {
+    None,
+    JumpToSelf,
+    StatusPolling,
+    Counter
+};
+
+// straight-line sequence of instructions, which are executed one by one without fetching
+struct TranslatedBlock {
+    std::vector<DecodedInstruction> instructions;
+    IdleLoop idleLoop;
+    // native code(see JIT), compiled on the first execution for CPU address nativeStart, nullptr if block can't be compiled
+    NativeBlock native;
+    Address nativeStart;
+    u32 nativeEpoch;        // native code is dropped when JIT epoch changes
+};
+
+/*
+    PRG-ROM is (almost) never modified, so instructions from it can be decoded only once.
+    Entries are indexed by offset in PRG-ROM(not by CPU address), so bank switching only remaps cache pages and entries of other banks stay valid.
+    Writing to PRG-ROM invalidates whole cache by increasing its generation.
+    Also cache stores translated blocks, which never cross bank window, so they stay valid after bank switching too.
+*/
+class DecodeCache : public Observer<MapperInterface> {
+public:
+    DecodeCache(MapperInterface& _mapper);
+    ~DecodeCache();
+    // returns nullptr if instruction at 'address' wasn't decoded yet
+    inline const DecodedInstruction* find(Address address) const {
+        if(address < 0x8000) return nullptr;
+        const DecodedInstruction& entry = pages[(address >> 8) & 0x7F][address & 0xFF];
+        return entry.generation == generation ? &entry : nullptr;
+    }
+    inline void store(Address address, u8 opcode, u16 operand, u8 length) {
+        // instruction, crossing bank window, can be decoded differently after bank switching
+        if(address < 0x8000 || (address % DecodeWindowSize) + length > DecodeWindowSize) return;
+        pages[(address >> 8) & 0x7F][address & 0xFF] = DecodedInstruction{operand, opcode, generation, 0};
+    }
+    inline TranslatedBlock* findBlock(Address address) {
+        const DecodedInstruction* entry = find(address);
+        return (entry && entry->block) ? &blocks[entry->block - 1] : nullptr;
+    }
+    // first instruction of block should be already stored
+    TranslatedBlock* storeBlock(Address address, TranslatedBlock&& block);
+    // changed on every bank switch or PRG-ROM write, so executed block can check if it's still actual
+    inline u32 version() const { return _version; }
+    void update(MapperInterface*, int eventType);
+
+    // the smallest PRG bank size of supported mappers
+    static const Address DecodeWindowSize = 0x2000;
+private:
+    void _mapPages();
+    void _invalidate();
+
+    MapperInterface& mapper;
+    std::vector<DecodedInstruction> entries;
+    // pages of CPU addresses $8000-$FFFF
+    std::array<DecodedInstruction*, 0x80> pages;
+    std::vector<TranslatedBlock> blocks;
+    u16 generation;
+    u32 _version;
+};
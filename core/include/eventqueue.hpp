@@ -1,14 +1,46 @@
 #pragma once
-#include <queue>
+#include <array>
+#include "common.hpp"
 
-enum class EventType {
-    InterruptNMI,
+/*
+    Events, which are processed by CPU after the current instruction.
+    Each event is a bit in the pending mask, and the lower bit has the higher priority: DMA > NMI > IRQ.
+    One-shot events(DMA, NMI) are removed when processed.
+    IRQs are lines: they stay pending until their source(mapper, APU) releases them, and are ignored while interrupts are disabled.
+*/
+enum class EventType : u32 {
     OAMDMAWrite,
+    InterruptNMI,
+    IRQMapper,
+    IRQAPUFrameCounter,
+    IRQAPUDMC,
+    Count
 };
 
 class EventQueue {
 public:
-    inline std::queue<EventType>& get() { return queue; }
+    static const u32 OneShotEventsMask = (1 << (u32)EventType::OAMDMAWrite) | (1 << (u32)EventType::InterruptNMI);
+    static const u32 IRQEventsMask = ~OneShotEventsMask & ((1 << (u32)EventType::Count) - 1);
+
+    EventQueue()
+        : pending{0}, timestamps{} {}
+    // cycle - master clock value, when event was posted
+    inline void post(EventType type, u64 cycle) { pending |= bit(type); timestamps[(u32)type] = cycle; }
+    inline void release(EventType type) { pending &= ~bit(type); }
+    inline bool empty() const { return !pending; }
+    inline bool isPending(EventType type) const { return pending & bit(type); }
+    inline bool oneShotPending() const { return pending & OneShotEventsMask; }
+    inline bool irqPending() const { return pending & IRQEventsMask; }
+    inline u64 timestamp(EventType type) const { return timestamps[(u32)type]; }
+    // removes and returns one-shot event with the highest priority(should be checked with oneShotPending() first)
+    inline EventType popOneShot() {
+        u32 index = __builtin_ctz(pending & OneShotEventsMask);
+        pending &= ~(1 << index);
+        return (EventType)index;
+    }
 private:
-    std::queue<EventType> queue;
+    static constexpr u32 bit(EventType type) { return 1 << (u32)type; }
+
+    u32 pending;
+    std::array<u64, (std::size_t)EventType::Count> timestamps;
 };
@@ -0,0 +1,31 @@
+#pragma once
+#include <array>
+#include "common.hpp"
+#include "framequeue.hpp"
+
+enum class PixelFormat {
+    RGB888,     // 0x00RRGGBB
+    ARGB8888,   // 0xFFRRGGBB
+    RGB565
+};
+
+/*
+    Converts PPU frames(palette indices with emphasis bits) to RGB pixels.
+    Every possible frame pixel(64 colors * 8 emphasis combinations) is precomputed.
+*/
+class FrameConverter {
+public:
+    FrameConverter(PixelFormat _format = PixelFormat::RGB888);
+    inline PixelFormat format() const { return pixelFormat; }
+    inline u32 pixel(u16 framePixel) const { return lut[framePixel & 0x1FF]; }
+    // 'out' should have place for 256*240 pixels: u16 for RGB565, u32 otherwise
+    void convert(const Frame& frame, void* out) const;
+    // same, but lines in 'out' are 'pitch' bytes apart(locked SDL texture, for example)
+    void convert(const Frame& frame, void* out, std::size_t pitch) const;
+
+    // channel is attenuated by this factor(in 1/256), if any other channel is emphasized
+    static const u32 EmphasisAttenuation = 192;
+private:
+    PixelFormat pixelFormat;
+    std::array<u32, 512> lut;
+};
@@ -1,47 +1,68 @@
 #pragma once
 #include <array>
-#include <queue>
-#include <mutex>
+#include <atomic>
+#include <thread>
 #include "common.hpp"
 
-typedef std::array<u32, 256*240> Frame;
+/*
+    Frame pixel is not RGB: bits 0-5 are NES palette index and bits 6-8 are color emphasis bits(red, green, blue) from PPUMASK.
+    It is converted to RGB only by those, who need real colors(see FrameConverter).
+*/
+typedef std::array<u16, 256*240> Frame;
+
+/*
+    Latest: consumer gets the newest complete frame, older ones are dropped. Producer never waits(used for display).
+    Every:  consumer gets every frame. Producer waits until the previous frame is taken(used for recorders).
+*/
+enum class FrameDelivery {
+    Latest,
+    Every
+};
 
 /*
+    Lock-free triple buffer for one producer(PPU) and one consumer(renderer).
     Active frame - frame, that currently is processed by PPU.
-    Render frame - frame, that should be rendered by the renderer.
+    Ready frame - the last complete frame, which isn't taken by consumer yet.
+    Render frame - frame, that is owned by the renderer until it asks for the next one.
+    Buffers are passed between them by exchanging indices, so no frame is overwritten while somebody uses it.
 */
-template<std::size_t N>
 class FrameQueue {
 public:
-    using Frames = std::array<Frame, N>;
     FrameQueue()
-        : frames{}, renderFramesQueue{}, activeFrame{0} {}
+        : frames{}, activeFrame{0}, renderFrame{1}, readyFrame{2}, delivery{FrameDelivery::Latest}, dropped{0}, stalls{0} {}
     inline Frame& getActiveFrame() { return frames[activeFrame]; }
-    FrameQueue& incrementActiveFrame() {
-        if (++activeFrame == N) activeFrame = 0;
-        return *this;
-    }
-    FrameQueue& pushActiveFrameToQueue() {
-        std::lock_guard<std::mutex> lck(queueMtx);
-        renderFramesQueue.push(&frames[activeFrame]);
+    // producer: makes active frame ready and takes a free buffer for the next one
+    FrameQueue& publishActiveFrame() {
+        if(delivery.load(std::memory_order_relaxed) == FrameDelivery::Every && (readyFrame.load(std::memory_order_acquire) & Fresh)) {
+            stalls.fetch_add(1, std::memory_order_relaxed);
+            while(readyFrame.load(std::memory_order_acquire) & Fresh) std::this_thread::yield();
+        }
+        u8 previous = readyFrame.exchange(activeFrame | Fresh, std::memory_order_acq_rel);
+        if(previous & Fresh) dropped.fetch_add(1, std::memory_order_relaxed);
+        activeFrame = previous & IndexMask;
         return *this;
     }
+    // consumer: returns new complete frame or nullptr, if there is no new one. Returned frame is valid until the next call
     Frame* getRenderFrame() {
-        std::lock_guard<std::mutex> lck(queueMtx);
-        if(!renderFramesQueue.empty()) {
-            Frame* res = renderFramesQueue.front();
-            renderFramesQueue.pop();
-            return res;
-        }
-        // renderer should wait, if there is no more frames to render
-        else {
-            return nullptr;
-        }
+        if(!(readyFrame.load(std::memory_order_acquire) & Fresh)) return nullptr;
+        renderFrame = readyFrame.exchange(renderFrame, std::memory_order_acq_rel) & IndexMask;
+        return &frames[renderFrame];
     }
+    inline void setDelivery(FrameDelivery val) { delivery.store(val, std::memory_order_relaxed); }
+    // frames, which were replaced by newer ones before consumer took them
+    inline u64 droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+    // how many times producer waited for consumer(only with FrameDelivery::Every)
+    inline u64 stalledFrames() const { return stalls.load(std::memory_order_relaxed); }
 private:
-    Frames frames;
-    std::queue<Frame*> renderFramesQueue;
-    u32 activeFrame;
+    // ready frame index is marked as fresh until consumer takes it
+    static const u8 Fresh = 0b100;
+    static const u8 IndexMask = 0b011;
 
-    std::mutex queueMtx;
+    std::array<Frame, 3> frames;
+    u8 activeFrame;
+    u8 renderFrame;
+    std::atomic<u8> readyFrame;
+    std::atomic<FrameDelivery> delivery;
+    std::atomic<u64> dropped;
+    std::atomic<u64> stalls;
 };
@@ -1,6 +1,8 @@
 #pragma once
 #include "core/include/common.hpp"
 
+struct ControllerState;
+
 class StandardController {
 public:
 
@@ -12,6 +14,9 @@ public:
     StandardController& strobe(bool high);
     StandardController& updateKey(Key key, bool pressed);
     bool read();
+    // snapshot(see Snapshot)
+    void saveState(ControllerState& state) const;
+    void loadState(const ControllerState& state);
 private:
     /*
         Status bits correspond to the following keys:
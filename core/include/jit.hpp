@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include "common.hpp"
+
+struct Registers;
+struct MemoryPage;
+enum class Operation;
+
+// native code is emitted only for x86-64 with System V calling convention(first argument in rdi) and mmap
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_NATIVE
+#endif
+
+/*
+    State, which native block works with. Block updates registers and RAM in place,
+    master clock and instructions count are returned in context and applied by CPU.
+*/
+struct JITContext {
+    Registers* registers;
+    u8* ram;                        // CPU memory: zero page and stack are accessed directly
+    const MemoryPage* readPages;
+    const MemoryPage* writePages;
+    u64 clock;                      // master clock, advanced by every executed instruction
+    u64 syncClock;                  // block stops after the instruction, which reaches it(PPU should catch up)
+    u64 executed;                   // instructions executed by the block
+};
+
+// returns true if block has stopped before instruction, which should be executed by interpreter(PC points to it)
+using NativeBlock = bool (*)(JITContext* context);
+
+// instruction of translated block with everything, which is needed to compile it
+struct JITInstruction {
+    Operation operation;
+    AddressationMode addrMode;
+    u8 cycles;
+    u8 pageCrossCycles;
+    u16 operand;
+    Address address;
+    u8 length;
+};
+
+/*
+    Compiles translated blocks into x86-64 code, which does exactly what interpreter does, including cycles and its quirks.
+    Only RAM, PRG-RAM and PRG-ROM reads are done natively: page of every other access is checked at runtime, and block stops
+        right before the instruction, which touches PPU, IO(APU, controllers, OAM DMA) or mapper registers, so interpreter
+        executes it with all synchronizations. Instructions, which interpreter does better(BRK, RTI, JMP indirect,
+        CLI and PLP, which can unmask pending IRQ, unknown opcodes), stop the block too.
+    Master clock is checked after every instruction: block stops when PPU should catch up, so events are processed on
+        the same instruction as in interpreter. Block, which jumps to its own start, loops natively until that happens.
+    Code is written into one buffer, when it's full, all compiled code is dropped(see epoch()).
+        Pages of the buffer are either writable(while code is emitted) or executable, never both.
+*/
+class JIT {
+public:
+    JIT();
+    ~JIT();
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+    // false if platform isn't supported or code buffer can't be allocated
+    inline bool available() const { return code != nullptr; }
+    // returns nullptr if the first instruction can't be executed natively
+    NativeBlock compile(const std::vector<JITInstruction>& instructions);
+    // changed when code buffer is cleared, blocks compiled before that should be compiled again
+    inline u32 epoch() const { return _epoch; }
+private:
+    static const std::size_t CodeSize = 4 << 20;
+    u8* code;
+    std::size_t used;
+    u32 _epoch;
+};
@@ -11,8 +11,9 @@
         mapped into $8000-$BFFF and mirrored on $C000 - $FFFF
     2 banks:
         mapped into $8000-$FFFF
+    Default 32 KB PRG and 8 KB CHR windows of MapperInterface are just what it needs(16 KB bank is mirrored).
 */
-class Mapper0 : public MapperInterface {
+class Mapper0 final : public MapperInterface {
 public:
     Mapper0(ROM& _rom, Logger* logger=nullptr);
     bool isCorrect() const;
@@ -20,10 +21,5 @@ public:
     Serialization::BytesCount serialize(std::string &buf);
     Serialization::BytesCount deserialize(const std::string &buf, Serialization::BytesCount offset);
 private:
-    bool checkAddress(Address address) const;
-    Address addressFix(Address address) const;
-    bool checkCHRAddress(Address address) const;
-    Address addressCHRFix(Address address) const;
-
     const u8 sz16kb;
 };
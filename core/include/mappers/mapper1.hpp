@@ -6,7 +6,7 @@
 
 // MAPPER 1 (MMC1)
 
-class Mapper1 : public MapperInterface {
+class Mapper1 final : public MapperInterface {
 public:
     Mapper1(ROM& _rom, Logger* logger=nullptr);
     std::optional<bool> write8(Address offset, u8 val);
@@ -14,20 +14,21 @@ public:
     // serialization
     Serialization::BytesCount serialize(std::string &buf);
     Serialization::BytesCount deserialize(const std::string &buf, Serialization::BytesCount offset);
+    void saveState(MapperState& state) const;
+    void loadState(const MapperState& state);
 private:
-    bool checkAddress(Address address) const;
-    Address addressFix(Address address) const;
-    bool checkCHRAddress(Address address) const;
-    Address addressCHRFix(Address address) const; 
-
     void initPRGBanks();
-    void fix();
     void fixPRGBanks();
     void fixCHRBanks();
     void fixMirroring();
+    // maps windows to current banks
+    void mapPRGBanks();
+    void mapCHRBanks();
 
     // registers
     u8 rLoad;
+    // 5 writes are needed to fill the shift register
+    u8 writeCount;
     u8 rControl;
     u8 rChrBank0;
     u8 rChrBank1;
@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include "core/include/rom.hpp"
+#include "core/include/mappers/mapperinterface.hpp"
+#include "log/log.hpp"
+#include "serialize/serializer.hpp"
+
+// MAPPER 4 (MMC3)
+
+/*
+    PRG: two switchable 8 KB banks(R6, R7) and two fixed to the last banks, R6 and the second to last bank can swap places.
+    CHR: two 2 KB banks(R0, R1) and four 1 KB banks(R2-R5), 2 KB and 1 KB halves can swap places.
+    Scanline counter is clocked by PPU on A12 rises(see MapperInterface), it asserts IRQ, when it becomes 0 while IRQ is enabled.
+*/
+class Mapper4 final : public MapperInterface {
+public:
+    Mapper4(ROM& _rom, Logger* logger=nullptr);
+    std::optional<bool> write8(Address offset, u8 val);
+    void clockScanlineCounter(u64 clock);
+    u32 scanlineIRQDistance() const;
+    // serialization
+    Serialization::BytesCount serialize(std::string &buf);
+    Serialization::BytesCount deserialize(const std::string &buf, Serialization::BytesCount offset);
+    void saveState(MapperState& state) const;
+    void loadState(const MapperState& state);
+private:
+    void fixPRGBanks();
+    void fixCHRBanks();
+    void fixMirroring();
+    void setIRQ(bool val, u64 clock);
+
+    // registers
+    u8 rBankSelect;
+    std::array<u8, 8> rBanks;
+    u8 rMirroring;
+    u8 rIrqLatch;
+
+    // scanline counter
+    u8 irqCounter;
+    bool irqReload;
+    bool irqEnabled;
+    bool irqAsserted;
+};
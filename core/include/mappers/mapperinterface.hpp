@@ -1,8 +1,11 @@
 #pragma once
+#include <array>
 #include <optional>
 #include "core/include/common.hpp"
 #include "core/include/rom.hpp"
+#include "core/include/eventqueue.hpp"
 #include "log/log.hpp"
+#include "observer/observer.hpp"
 
 // basic class for mappers
 
@@ -15,8 +18,25 @@
 
     I use std::optional to show if request was processed by mapper.
     If not, std::nullopt will be returned and memory should process it itself.
+
+    Mapper notifies its observers(CPU memory, decode cache, PPU memory, CHR cache) when it switches banks or mirroring, so they can remap their pages.
+
+    Banking: $8000-$FFFF is split into 4 PRG windows of 8 KB and $0000-$1FFF into 8 CHR windows of 1 KB.
+    Window stores offset of its bank in PRG-ROM/CHR. Mapper remaps windows(mapPRG*, mapCHR*) only when its bank registers change,
+        so every access is just a table lookup. Offsets(not pointers) are stored, because caches are indexed by them.
 */
-class MapperInterface : public Serialization::Serializable, public Serialization::Deserializable {
+struct MapperState;
+
+enum class MapperEvent {
+    PRGBanksSwitched,
+    PRGROMWritten,
+    CHRBanksSwitched,
+    CHRRAMLoaded,
+    MirroringChanged,
+    ScanlineCounterChanged
+};
+
+class MapperInterface : public Observable<MapperInterface>, public Serialization::Serializable, public Serialization::Deserializable {
 public:
     MapperInterface(ROM& _rom, Logger* logger=nullptr);
     virtual ~MapperInterface() {}
@@ -26,19 +46,61 @@ public:
     virtual std::optional<bool> write16(Address offset, u16 val);
     virtual std::optional<u8> readCHR(Address);
     virtual std::optional<bool> writeCHR(Address offset, u8 val);
+    // pointer to 256 bytes of PRG-ROM, mapped to page starting at 'address'(should be >= 0x8000)
+    inline u8* prgPage(Address address) { return &rom.PRGROM()[prgOffset(address)]; }
+    // offset in PRG-ROM of the byte mapped to 'address'(should be >= 0x8000)
+    inline Address prgOffset(Address address) const { return prgWindows[(address >> 13) & 0b11] | (address & (PRGWindowSize - 1)); }
+    inline std::size_t prgSize() const { return rom.PRGROM().size(); }
+    // offset in CHR of the byte mapped to PPU 'address'(should be < 0x2000)
+    inline Address chrOffset(Address address) const { return chrWindows[(address >> 10) & 0b111] | (address & (CHRWindowSize - 1)); }
+    inline const DinBytes& chr() const { return rom.CHRROM(); }
+    inline std::size_t chrSize() const { return rom.CHRROM().size(); }
     inline Mirroring mirroring() const { return _mirroring; }
+    // mapper IRQs are posted to CPU's event queue
+    inline void setEventQueue(EventQueue* queue) { eventQueue = queue; }
+
+    /*
+        Scanline counter(MMC3) is clocked by rising edge of PPU A12. PPU knows on which dot it happens, so it clocks counter there
+            instead of watching every CHR fetch. 'clock' - PPU clock of the edge.
+        scanlineIRQDistance() - on which rise from now IRQ will be asserted(0 - never), PPU synchronizes with CPU on that rise.
+        Mapper notifies ScanlineCounterChanged, when distance is changed not by clocking.
+    */
+    inline bool hasScanlineCounter() const { return scanlineCounter; }
+    virtual void clockScanlineCounter(u64) {}
+    virtual u32 scanlineIRQDistance() const { return 0; }
     // serialization
     virtual Serialization::BytesCount serialize(std::string &buf) = 0;
     virtual Serialization::BytesCount deserialize(const std::string &buf, Serialization::BytesCount offset) = 0;
+    // snapshot(see Snapshot): base class saves CHR-RAM, mappers add their registers
+    virtual void saveState(MapperState& state) const;
+    virtual void loadState(const MapperState& state);
+
+    static const Address PRGWindowSize = 0x2000;
+    static const Address CHRWindowSize = 0x400;
 protected:
-    virtual bool checkAddress(Address address) const = 0;
-    virtual Address addressFix(Address address) const = 0;
-    virtual bool checkCHRAddress(Address address) const = 0;
-    virtual Address addressCHRFix(Address address) const = 0;
+    inline bool checkAddress(Address address) const { return address >= 0x8000; }
+    inline bool checkCHRAddress(Address address) const { return address < 0x2000; }
+
+    // map 'bank'(in units of mapped size) to window(s) starting at 'window'. Negative bank is counted from the end(-1 - the last one)
+    void mapPRG8k(u8 window, int bank) { _mapBank(prgWindows.data(), window, 1, PRGWindowSize, bank, prgSize()); }
+    void mapPRG16k(u8 window16k, int bank) { _mapBank(prgWindows.data(), window16k * 2, 2, PRGWindowSize, bank, prgSize()); }
+    void mapPRG32k(int bank) { _mapBank(prgWindows.data(), 0, 4, PRGWindowSize, bank, prgSize()); }
+    void mapCHR1k(u8 window, int bank) { _mapBank(chrWindows.data(), window, 1, CHRWindowSize, bank, chrSize()); }
+    void mapCHR2k(u8 window2k, int bank) { _mapBank(chrWindows.data(), window2k * 2, 2, CHRWindowSize, bank, chrSize()); }
+    void mapCHR4k(u8 window4k, int bank) { _mapBank(chrWindows.data(), window4k * 4, 4, CHRWindowSize, bank, chrSize()); }
+    void mapCHR8k(int bank) { _mapBank(chrWindows.data(), 0, 8, CHRWindowSize, bank, chrSize()); }
 
     ROM& rom;
     Logger* logger;
     Mirroring _mirroring;
+    EventQueue* eventQueue;
+    bool scanlineCounter;
+    bool chrRAM;
+private:
+    static void _mapBank(Address* windows, u8 first, u8 count, Address windowSize, int bank, std::size_t size);
+
+    std::array<Address, 4> prgWindows;
+    std::array<Address, 8> chrWindows;
 };
 
 class InvalidMapperException {};
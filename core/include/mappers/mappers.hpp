@@ -1,5 +1,11 @@
 #pragma once
 #include "mapper0.hpp"
 #include "mapper1.hpp"
+#include "mapper4.hpp"
 
+/*
+    Virtual mapper interface is used only off the hot path: bank switches, register writes and rare fallbacks.
+    CPU reads PRG-ROM through Memory page table and decode cache, PPU reads CHR through CHR cache,
+        both are remapped on mapper events, so per-access cost doesn't depend on the mapper type.
+*/
 Sptr<MapperInterface> makeMapper(int number, ROM& rom, Logger* logger);
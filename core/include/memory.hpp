@@ -4,19 +4,59 @@
 #include "input.hpp"
 #include "common.hpp"
 #include "mappers/mappers.hpp"
+#include "observer/observer.hpp"
 
-class Memory {
+/*
+    CPU address space is split into 256 pages of 256 bytes, separately for reading and writing.
+    Page either points directly to the host memory(RAM and its mirrors, PRG-RAM, banked PRG-ROM),
+    or is processed by a handler(PPU and IO registers, mapper registers).
+*/
+enum class PageHandler : u8 {
+    Direct,
+    PPURegisters,
+    IORegisters,
+    Mapper
+};
+
+struct MemoryPage {
+    u8* data;       // nullptr if page is processed by handler
+    PageHandler handler;
+};
+
+class Memory : public Observer<MapperInterface> {
 public:
     Memory(MapperInterface& _mapper, PPU& _ppu, StandardController& _contr1, StandardController& _contr2);
-    u8 read8(Address offset);
-    Memory& write8(Address offset, u8 val);
+    ~Memory();
+    inline u8 read8(Address offset) {
+        const MemoryPage& page = readPages[(offset >> 8) & 0xFF];
+        if(page.data) return page.data[offset & 0xFF];
+        return _readHandler(offset);
+    }
+    inline Memory& write8(Address offset, u8 val) {
+        const MemoryPage& page = writePages[(offset >> 8) & 0xFF];
+        if(page.data) page.data[offset & 0xFF] = val;
+        else _writeHandler(offset, val);
+        return *this;
+    }
     u16 read16(Address offset);
     Memory& write16(Address offset, u16 val);
     inline auto& get() { return memory; }
+    inline MapperInterface& getMapper() { return mapper; }
+    inline const MemoryPage& readPage(u8 page) const { return readPages[page]; }
+    inline const MemoryPage* readPageTable() const { return readPages.data(); }
+    inline const MemoryPage* writePageTable() const { return writePages.data(); }
+    // mapper switched banks
+    void update(MapperInterface*, int eventType);
 private:
+    u8 _readHandler(Address offset);
+    void _writeHandler(Address offset, u8 val);
+    void _mapPages();
+    void _mapPRGPages();
     Address _mirrorAddressFix(Address address);
 
     std::array<u8, 0x10000> memory;
+    std::array<MemoryPage, 0x100> readPages;
+    std::array<MemoryPage, 0x100> writePages;
     MapperInterface& mapper;
     // needed to access ppu registers
     PPU& ppu;
@@ -25,7 +65,3 @@ private:
 };
 
 bool isInPPURegisters(Address address);
-
-
-
-
@@ -7,6 +7,9 @@
 #include "observer/observer.hpp"
 #include "serialize/serializer.hpp"
 #include "framequeue.hpp"
+#include "compositor.hpp"
+
+struct PPUState;
 
 struct PPURegisters {
     PPURegisters();
@@ -49,7 +52,7 @@ public:
     inline u8 readPpuctrlMasterSlave() const { return (ppuRegisters.ppuctrl & 0b01000000) >> 6; }
     inline u8 readPpuctrlVblankNMI() const { return (ppuRegisters.ppuctrl & 0b10000000) >> 7; }
 
-    inline PPURegistersAccess& writePpumask(u8 val) { ppuRegisters.ppumask = val; return *this; }
+    PPURegistersAccess& writePpumask(u8 val);
     inline PPURegistersAccess& writePpumaskGreyscale(u8 val) { val ? setBit(ppuRegisters.ppumask, 0) : clearBit(ppuRegisters.ppumask, 0); return *this; }
     inline PPURegistersAccess& writePpumaskShowBckgLeftmost8(u8 val) { val ? setBit(ppuRegisters.ppumask, 1) : clearBit(ppuRegisters.ppumask, 1); return *this; }
     inline PPURegistersAccess& writePpumaskShowSpritesLeftmost8(u8 val) { val ? setBit(ppuRegisters.ppumask, 2) : clearBit(ppuRegisters.ppumask, 2); return *this; }
@@ -122,7 +125,7 @@ private:
 class NES;
 
 // making ppu observable so it ask gui for rendering during vblank
-class PPU : public Observable<PPU>, public Serialization::Serializable, public Serialization::Deserializable{
+class PPU : public Observable<PPU>, public Observer<MapperInterface>, public Serialization::Serializable, public Serialization::Deserializable{
 public:
     // only 14 bits out of 15
     const Address AccessAddressMask = 0b11111111111111;
@@ -135,11 +138,24 @@ public:
     template<typename std::size_t N> using Bytes = std::array<u8, N>;
 
     PPU(PPUMemory& _memory, EventQueue& eventQueue, Logger* logger = nullptr);
+    ~PPU();
     inline PPURegistersAccess& accessPPURegisters() { return ppuRegisters; }
     inline auto currentFrame() const { return frame; }
     inline auto& getOAM() { return OAM; }
     void step();
-    void emulateCycle();
+
+    /*
+        Catch-up scheduling: CPU only advances the master clock, and PPU runs lazily up to it in one batch.
+        It happens when CPU touches PPU registers or mapper, and when some PPU event(vblank, frame end) is due.
+    */
+    inline void addMasterCycles(u32 ppuCycles) { masterClock += ppuCycles; }
+    inline bool syncNeeded() const { return masterClock >= nextSyncClock; }
+    inline void catchUp() { if(clock < masterClock) _catchUp(); }
+    inline u64 masterCycles() const { return masterClock; }
+    // master clock value, on which next PPU event should be processed
+    inline u64 nextEventCycles() const { return nextSyncClock; }
+    // PPUSTATUS can be changed only by the next event if vblank isn't set yet, and sprite 0 hit can't occur(outside of visible scanlines or without rendering)
+    inline bool statusStableUntilEvent() const { return !(ppuRegisters.ppuRegisters.ppustatus & 0b10000000) && (scanline >= 240 || renderingDisabled()); }
 
     // write access is FORBIDDEN during rendering(not in vblank or if rendering enabled). Reading is possible(and, in fact, it is used in some games)
     // I should not read ppustatus via method, because reading it clears vblank
@@ -148,12 +164,27 @@ public:
     bool isItSprite0(u8 secondaryOAMIndex) const;
 
     inline void setDrawDebugGrid(bool val) { drawDebugGrid = val; }
+    // whole scanlines are rendered at once, when CPU can't access PPU in the middle of them(see _catchUp()), disabled - always dot by dot
+    inline void setScanlineRendering(bool enabled) { scanlineRendering = enabled; }
+    /*
+        Frame, which is not rendered, is emulated as usual(fetches, sprite evaluation, sprite 0 hit and overflow, scrolling),
+        but pixel colors aren't looked up(only transparency, which sprite 0 hit needs), its scanlines are not composed
+        and it is not pushed to the frame queue. Takes effect from the next frame.
+    */
+    inline void setFrameRendering(bool enabled) { renderNextFrame = enabled; }
+    inline bool frameRendered() const { return renderFrame; }
 
     // serialization
     Serialization::BytesCount serialize(std::string &buf);
     Serialization::BytesCount deserialize(const std::string &buf, Serialization::BytesCount offset);
+    // snapshot(see Snapshot), PPU should be caught up before saving
+    void saveState(PPUState& state) const;
+    void loadState(const PPUState& state);
 
     inline Frame* getRenderFrame() { return frameQueue.getRenderFrame(); }
+    inline FrameQueue& getFrameQueue() { return frameQueue; }
+    // mapper's scanline counter was changed by CPU
+    void update(MapperInterface*, int eventType);
 
 private:
     inline auto& image() { return frameQueue.getActiveFrame(); }
@@ -162,13 +193,24 @@ private:
     void postRender();
     void verticalBlank();
     void pixelRender();
-    void drawBackgroundPixel(u8 xCoord, u8 yCoord);
-    void drawSpritePixel(u8 yCoord);
-    u32 colorMultiplexer(bool bckgTransparent, u32 bckgColor, bool spriteTransparent, u32 spriteColor, u8 spritePriority);
-    u32 getForcedBlankColor() const;
+    inline void drawBackgroundPixel(u8 xCoord, u8 ppumask);
+    void drawSpritePixel();
+    // sprite pixel overrides background pixel
+    inline void _setSpritePixel(u8 xCoord, u8 color) { lineSprites[xCoord] = color; lineSpritesMask[xCoord] = 0xFF; }
+    void _composeScanline();
+    // palette index
+    u8 getForcedBlankColor() const;
 
     void setVblank(bool val);
 
+    void _catchUp();
+    u16 _scanlineLength() const;
+    void _nextScanline();
+    void _renderScanline();
+    void _updateNextSyncClock();
+    u16 _a12RiseCycle() const;
+    u64 _a12RiseClock(u32 rises, u16 riseCycle) const;
+
     Address _getTileAddress();
     Address _getAttributeAddress();
     Address _getPatternLower(u8 index);
@@ -183,11 +225,14 @@ private:
     void _renderInternalBckgShifts();
     void _spriteEvaluateClearSecondaryOAM();
     void _spriteEvaluate();
+    u64 _spritesOnLine(i16 line, u8 spriteHeight) const;
+    void _spriteEvaluateScanline();
     void _spriteEvaluateFetchData();
     void _spriteEvaluateFedData();
 
     PPURegistersAccess ppuRegisters;
     PPUMemory& memory;
+    MapperInterface& mapper;
     EventQueue& eventQueue;
     Logger* logger;
 
@@ -215,6 +260,10 @@ private:
     std::array<u8, 0x100> OAM;
     std::array<u8, 0x20> secondaryOAM;
     PPUDrawnMap ppuMap;
+    // current scanline as palette indices: background, sprites and mask of pixels, where sprites are drawn over background
+    Bytes<256> lineBckg;
+    Bytes<256> lineSprites;
+    Bytes<256> lineSpritesMask;
 
     Shifts8<16> spritesPatternDataShifts8;
     Bytes<8> spriteAttributeBytes;
@@ -222,12 +271,28 @@ private:
 
     u8 spriteLowPatternByte;
     u8 spriteHighPatternByte;
+    // pattern addresses of the tile/sprite being fetched: low byte is read on one dot, high byte(address + 8) - two dots later
+    Address lowBgByteAddr;
+    Address spritePatternAddr;
+    // PPUDATA read buffer: reads below palettes return the previously read byte
+    u8 readBuffer;
+    // sprite evaluation state: OAM[n*4 + m] is the current byte, slot - current sprite in secondary OAM
+    u8 spriteEvalM;
+    u16 spriteEvalN;
+    u8 spriteEvalSlot;
 
     // --- private
     u64 frame;
     i16 scanline;
     u16 cycle;      // this scanline cycle
     bool drawDebugGrid;
-
-    FrameQueue<4> frameQueue;
+    bool scanlineRendering;
+    bool renderFrame;
+    bool renderNextFrame;
+    // emulated PPU cycles, master clock(in PPU cycles) and master clock value when PPU should be synchronized next time
+    u64 clock;
+    u64 masterClock;
+    u64 nextSyncClock;
+
+    FrameQueue frameQueue;
 };
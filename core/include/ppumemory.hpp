@@ -2,6 +2,7 @@
 #include <array>
 #include "core/include/common.hpp"
 #include "core/include/mappers/mappers.hpp"
+#include "core/include/chrcache.hpp"
 
 const std::array<u32, 64> Palette = {
     4605510, 1626, 1656, 132723, 3474252, 5701646, 5898240, 4259840, 1180160, 5120, 7680, 7680, 5409, 0, 0, 0, 10329501, 19129,
@@ -11,21 +12,35 @@ const std::array<u32, 64> Palette = {
 };
 
 
-class PPUMemory {
+/*
+    Nametables($2000-$2FFF, mirrored at $3000-$3EFF) are 4 pages of 1 KB, each of them is mapped to some physical page of VRAM.
+    Page table is updated only when mapper changes mirroring.
+*/
+class PPUMemory : public Observer<MapperInterface> {
 public:
     PPUMemory(MapperInterface& _mapper, Logger* logger=nullptr);
+    ~PPUMemory();
     u8 read(Address address);
-    // USE WITH CARE!
-    u8 readCHR(Address address);
+    // USE WITH CARE! Address should be < 0x2000
+    inline u8 readCHR(Address address) const { return chrCache.get(address).plane; }
+    // reversed byte of CHR, used for horizontally flipped sprites
+    inline u8 readCHRFlipped(Address address) const { return chrCache.get(address).flipped; }
     u8 readDirectly(Address address);
     u8 readDirectlyWithoutChecks(Address address);
+    // address should be in $2000-$3EFF
+    inline u8 readNametable(Address address) const { return memory[nametablePages[(address >> 10) & 0b11] | (address & 0x3FF)]; }
     PPUMemory& write(Address address, u8 val);
     inline auto& getMemory () { return memory; }
+    inline MapperInterface& getMapper() { return mapper; }
+    void update(MapperInterface*, int eventType);
 private:
     Address _fixAddress(Address address);
-    Address _applyMirroring(Address address);
+    void _mapNametables();
 
     std::array<u8, 0x4000> memory;
+    // offsets in memory of the physical pages, mapped to nametables 0-3
+    std::array<Address, 4> nametablePages;
     MapperInterface& mapper;
+    CHRCache chrCache;
     Logger* logger;
 };
@@ -0,0 +1,67 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include "common.hpp"
+#include "snapshot.hpp"
+
+/*
+    History of snapshots for rewinding, stored in a fixed byte ring(its size is the memory limit, nothing is allocated after construction).
+    Every keyframeInterval-th snapshot is a keyframe, the others are deltas: XOR with the previous keyframe.
+        CPU RAM and VRAM change a little between frames, so XOR is mostly zeros.
+    Both are stored as runs of zero and literal 8-byte words: keyframe is encoded against zeros(CHR-RAM and PRG-RAM are mostly empty).
+    When ring is full, the oldest keyframe is dropped together with its deltas.
+    Entries are ordered by frame: pushing a snapshot drops the ones from its "future"(after rewind or load).
+*/
+class RewindBuffer {
+public:
+    RewindBuffer(std::size_t memoryLimit, u32 keyframeInterval);
+
+    // snapshot should be saved here before push()
+    inline Snapshot& snapshot() { return current; }
+    void push();
+    // restores the newest snapshot, taken not later than 'frame'(or the oldest one), into snapshot() and drops the newer ones
+    const Snapshot* restore(u64 frame);
+    void clear();
+
+    // statistics
+    inline std::size_t capacity() const { return ring.size(); }
+    inline std::size_t memoryUsage() const { return usedBytes; }
+    inline std::size_t snapshotsCount() const { return entries.size(); }
+    inline u64 oldestFrame() const { return entries.empty() ? 0 : entries.front().frame; }
+    // bytes needed for one minute(3600 frames) of history at current rate
+    std::size_t bytesPerMinute() const;
+    // average time of push() in nanoseconds
+    inline u64 averagePushTime() const { return pushes ? pushTime / pushes : 0; }
+private:
+    struct Entry {
+        u64 frame;
+        std::size_t offset;
+        std::size_t size;
+        bool keyframe;
+    };
+
+    // writes XOR of 'data' and 'reference'(zeros if nullptr) as runs: u16 zero words count, u16 literal words count, literal words
+    static std::size_t _encode(const u8* data, const u8* reference, u8* out);
+    static void _decode(const u8* in, std::size_t size, const u8* reference, u8* out);
+    // drops entries, which are not older than 'frame'
+    void _dropFrom(u64 frame);
+    void _dropOldest();
+    void _store(std::size_t size, bool keyframe);
+    // decodes keyframe of the group, entry 'index' belongs to, into reference
+    void _loadReference(std::size_t index);
+
+    std::vector<u8> ring;
+    std::deque<Entry> entries;
+    // end of the newest entry in ring
+    std::size_t head;
+    std::size_t usedBytes;
+    u32 keyframeInterval;
+    Snapshot current;
+    // decoded keyframe of the newest group, deltas are made against it
+    Snapshot reference;
+    u64 referenceFrame;
+    bool referenceValid;
+    std::vector<u8> encoded;
+    u64 pushTime;
+    u64 pushes;
+};
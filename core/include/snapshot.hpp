@@ -0,0 +1,97 @@
+#pragma once
+#include <array>
+#include <type_traits>
+#include "common.hpp"
+#include "cpu.hpp"
+#include "ppu.hpp"
+#include "eventqueue.hpp"
+
+/*
+    Snapshot is the whole emulated state in one preallocated, fixed-size and trivially copyable struct.
+    It is taken and restored at any instruction boundary with plain copies(no allocations, no serialization),
+        so it is cheap enough for rewind, run-ahead and search. Snapshot can be copied itself with a single memcpy.
+    Unlike save files, snapshot is valid only for the same ROM and the same build(Version).
+    PRG-ROM isn't a part of it: writes to it are a bug of the game anyway.
+    Host state(throttling, frameskip, frame queue) isn't a part of it: after restoring, frame in progress is finished
+        from the restored scanline, lines above it are left from the frame, which was drawn before.
+*/
+
+struct CPUState {
+    Registers registers;
+    u64 instructionCounter;
+    // $0000-$7FFF: RAM, IO and PRG-RAM(everything above is PRG-ROM)
+    std::array<u8, 0x8000> memory;
+};
+
+struct PPUState {
+    PPURegisters registers;
+    Address v;
+    Address t;
+    u8 x;
+    u8 w;
+    PPU::Shifts16<2> patternDataShifts16;
+    PPU::Shifts8<2> attrDataShifts8;
+    PPU::Latches<2> attrDataLatches;
+    u8 ntByte;
+    u8 attrByte;
+    u8 lowBgByte;
+    u8 highBgByte;
+    std::array<u8, 0x100> OAM;
+    std::array<u8, 0x20> secondaryOAM;
+    std::array<bool, 256> bckgMap;
+    std::array<bool, 256> spriteMap;
+    PPU::Bytes<256> lineBckg;
+    PPU::Bytes<256> lineSprites;
+    PPU::Bytes<256> lineSpritesMask;
+    PPU::Shifts8<16> spritesPatternDataShifts8;
+    PPU::Bytes<8> spriteAttributeBytes;
+    PPU::Counters<8> spriteXCounters;
+    u8 spriteLowPatternByte;
+    u8 spriteHighPatternByte;
+    Address lowBgByteAddr;
+    Address spritePatternAddr;
+    u8 readBuffer;
+    u8 spriteEvalM;
+    u16 spriteEvalN;
+    u8 spriteEvalSlot;
+    u64 frame;
+    i16 scanline;
+    u16 cycle;
+    bool renderFrame;
+    bool renderNextFrame;
+    u64 clock;
+    // VRAM: nametables and palettes
+    std::array<u8, 0x4000> memory;
+};
+
+struct MapperState {
+    // mapper specific registers, each mapper packs them in its own way
+    std::array<u8, 32> registers;
+    // CHR-RAM(only if ROM has no CHR)
+    std::array<u8, 0x2000> chrRAM;
+};
+
+struct ControllerState {
+    u8 status;
+    u8 keysStatus;
+    bool strobe;
+    u8 lowStrobeRead;
+};
+
+struct Snapshot {
+    // should be increased on every change of state layout
+    static const u32 Version = 2;
+
+    u32 version;
+    // mapper number of the ROM, snapshot was taken from
+    u8 mapper;
+    CPUState cpu;
+    PPUState ppu;
+    MapperState mapperState;
+    std::array<ControllerState, 2> controllers;
+    EventQueue events;
+};
+
+static_assert(std::is_trivially_copyable<Snapshot>::value, "Snapshot should be copyable with memcpy");
+
+class InvalidSnapshotException {};
@@ -1,4 +1,5 @@
 #include "core/include/input.hpp"
+#include "core/include/snapshot.hpp"
 
 StandardController::StandardController()
     : status{0}, keysStatus{0}, _strobe{false}, lowStrobeRead{0} {}
@@ -26,3 +27,14 @@ bool StandardController::read() {
     status >>= 1;
     return res;
 }
+
+void StandardController::saveState(ControllerState& state) const {
+    state = ControllerState{status, keysStatus, _strobe, lowStrobeRead};
+}
+
+void StandardController::loadState(const ControllerState& state) {
+    status = state.status;
+    keysStatus = state.keysStatus;
+    _strobe = state.strobe;
+    lowStrobeRead = state.lowStrobeRead;
+}
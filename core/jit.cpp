@@ -0,0 +1,624 @@
+#include "include/jit.hpp"
+#include "include/cpu.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#ifdef JIT_NATIVE
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef JIT_NATIVE
+namespace {
+    enum Reg : u8 { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11, NoIndex = 0xFF };
+    // condition codes of jcc and setcc
+    enum Condition : u8 { Below = 2, AboveEqual = 3, Equal = 4, NotEqual = 5, Above = 7 };
+    // ModRM.reg extension of 0x80/0x81 group and 'op r/m, r' opcode(group * 8 + 1)
+    enum Group : u8 { Add = 0, Or = 1, And = 4, Sub = 5, Xor = 6, Cmp = 7 };
+
+    // memory operand [base + index + disp]
+    struct Mem {
+        u8 base;
+        u8 index;
+        u32 disp;
+    };
+
+    /*
+        Registers of native block:
+            rdi - JITContext, rsi - Registers, r8 - master clock, r9 - CPU memory, r10/r11 - read/write page tables,
+            rax, rcx, rdx - scratch(all of them are caller-saved, so nothing is pushed).
+    */
+    const Mem RegA{RSI, NoIndex, offsetof(Registers, A)};
+    const Mem RegX{RSI, NoIndex, offsetof(Registers, X)};
+    const Mem RegY{RSI, NoIndex, offsetof(Registers, Y)};
+    const Mem RegPC{RSI, NoIndex, offsetof(Registers, PC)};
+    const Mem RegS{RSI, NoIndex, offsetof(Registers, S)};
+    const Mem RegNZ{RSI, NoIndex, offsetof(Registers, nz)};
+    const Mem RegC{RSI, NoIndex, offsetof(Registers, c)};
+    const Mem RegV{RSI, NoIndex, offsetof(Registers, v)};
+    const Mem RegFlags{RSI, NoIndex, offsetof(Registers, flags)};
+    const Mem SyncClock{RDI, NoIndex, offsetof(JITContext, syncClock)};
+    const Mem Executed{RDI, NoIndex, offsetof(JITContext, executed)};
+
+    // page tables are indexed by page * 16
+    static_assert(sizeof(MemoryPage) == 16 && offsetof(MemoryPage, data) == 0, "JIT expects 16 byte memory pages");
+
+    /*
+        Just instruction forms, which compiler uses. Memory operands are always encoded with 32 bit displacement,
+            REX prefix is always emitted(so byte registers are al, cl and dl).
+        Bytes past the end of buffer are counted, but not written, so overflow can be checked after the block.
+    */
+    class Assembler {
+    public:
+        Assembler(u8* _begin, u8* _end)
+            : begin{_begin}, pos{_begin}, end{_end} {}
+        inline std::size_t size() const { return pos - begin; }
+        inline bool overflow() const { return pos > end; }
+
+        void movzx8(u8 reg, Mem m) { op(false, reg, m, {0x0F, 0xB6}); }
+        void movzx16(u8 reg, Mem m) { op(false, reg, m, {0x0F, 0xB7}); }
+        void movzx8(u8 reg, u8 rm) { opReg(false, reg, rm, {0x0F, 0xB6}); }
+        void mov8(Mem m, u8 reg) { op(false, reg, m, {0x88}); }
+        void mov16(Mem m, u8 reg) { byte(0x66); op(false, reg, m, {0x89}); }
+        void mov64(u8 reg, Mem m) { op(true, reg, m, {0x8B}); }
+        void mov64(Mem m, u8 reg) { op(true, reg, m, {0x89}); }
+        void mov32(u8 dst, u8 src) { opReg(false, src, dst, {0x89}); }
+        void movImm8(Mem m, u8 imm) { op(false, 0, m, {0xC6}); byte(imm); }
+        void movImm16(Mem m, u16 imm) { byte(0x66); op(false, 0, m, {0xC7}); word(imm); }
+        void movImm32(u8 reg, u32 imm) { byte(0x40 | (reg >> 3)); byte(0xB8 + (reg & 7)); dword(imm); }
+        void aluImm(Group group, u8 reg, u32 imm, bool wide = false) { opReg(wide, group, reg, {0x81}); dword(imm); }
+        void aluReg(Group group, u8 dst, u8 src) { opReg(false, src, dst, {(u8)(group * 8 + 1)}); }
+        void alu8(Group group, u8 dst, Mem src) { op(false, dst, src, {(u8)(group * 8 + 2)}); }
+        void alu8(Group group, Mem m, u8 imm) { op(false, group, m, {0x80}); byte(imm); }
+        void alu64(Group group, Mem m, u32 imm) { op(true, group, m, {0x81}); dword(imm); }
+        void cmp64(u8 reg, Mem m) { op(true, reg, m, {0x3B}); }
+        void test64(u8 reg) { opReg(true, reg, reg, {0x85}); }
+        void test32(u8 reg, u32 imm) { opReg(false, 0, reg, {0xF7}); dword(imm); }
+        void test8(Mem m, u8 imm) { op(false, 0, m, {0xF6}); byte(imm); }
+        void test16(Mem m, u16 imm) { byte(0x66); op(false, 0, m, {0xF7}); word(imm); }
+        void shl(u8 reg, u8 amount) { opReg(false, 4, reg, {0xC1}); byte(amount); }
+        void shr(u8 reg, u8 amount) { opReg(false, 5, reg, {0xC1}); byte(amount); }
+        void not32(u8 reg) { opReg(false, 2, reg, {0xF7}); }
+        void neg32(u8 reg) { opReg(false, 3, reg, {0xF7}); }
+        void setcc(Condition condition, u8 reg) { opReg(false, 0, reg, {0x0F, (u8)(0x90 + condition)}); }
+        // jumps return position of their rel32, which is set by bind()
+        std::size_t jcc(Condition condition) { byte(0x0F); byte(0x80 + condition); return rel32(); }
+        std::size_t jmp() { byte(0xE9); return rel32(); }
+        void ret() { byte(0xC3); }
+        void bind(std::size_t jump, std::size_t target) {
+            u32 offset = target - (jump + 4);
+            for(int i = 0; i < 4; ++i) if(begin + jump + i < end) begin[jump + i] = offset >> (i * 8);
+        }
+    private:
+        inline void byte(u8 val) { if(pos < end) *pos = val; ++pos; }
+        inline void word(u16 val) { byte(val); byte(val >> 8); }
+        inline void dword(u32 val) { word(val); word(val >> 16); }
+        std::size_t rel32() { dword(0); return size() - 4; }
+        void op(bool wide, u8 reg, Mem m, std::initializer_list<u8> opcode) {
+            u8 index = m.index == NoIndex ? 0 : m.index;
+            byte(0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (m.base >> 3));
+            for(u8 b : opcode) byte(b);
+            // mod = 10: disp32, rm = 100: SIB follows(needed for index and for rsp/r12 base)
+            if(m.index == NoIndex && (m.base & 7) != 4) byte(0x80 | ((reg & 7) << 3) | (m.base & 7));
+            else {
+                byte(0x84 | ((reg & 7) << 3));
+                byte(((m.index == NoIndex ? 4 : m.index & 7) << 3) | (m.base & 7));
+            }
+            dword(m.disp);
+        }
+        void opReg(bool wide, u8 reg, u8 rm, std::initializer_list<u8> opcode) {
+            byte(0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3));
+            for(u8 b : opcode) byte(b);
+            byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        u8* begin;
+        u8* pos;
+        u8* end;
+    };
+
+    bool writesMemory(const JITInstruction& instruction) {
+        switch(instruction.operation) {
+        case Operation::STA: case Operation::STX: case Operation::STY: case Operation::INC: case Operation::DEC:
+            return true;
+        case Operation::ASL: case Operation::LSR: case Operation::ROL: case Operation::ROR:
+            return instruction.addrMode != AddressationMode::Accumulator;
+        default:
+            return false;
+        }
+    }
+
+    // instructions, which block stops before without checking anything at runtime
+    bool compilable(const JITInstruction& instruction) {
+        switch(instruction.operation) {
+        case Operation::BRK: case Operation::RTI: case Operation::CLI: case Operation::PLP: case Operation::UNK:
+            return false;
+        case Operation::JMP:
+            return instruction.addrMode == AddressationMode::Absolute;
+        case Operation::JSR:
+            return true;
+        default:
+            break;
+        }
+        if(instruction.addrMode != AddressationMode::Absolute) return true;
+        // PPU and IO registers, writes to mapper
+        if(instruction.operand >= 0x2000 && instruction.operand < 0x4100) return false;
+        return !(writesMemory(instruction) && instruction.operand >= 0x8000);
+    }
+
+    class BlockCompiler {
+    public:
+        BlockCompiler(Assembler& _a, const std::vector<JITInstruction>& _instructions)
+            : a{_a}, instructions{_instructions}, start{(u16)_instructions[0].address} {}
+        // returns false if the first instruction can't be compiled
+        bool compile();
+    private:
+        // instruction with index 'current' is compiled
+        inline u16 currentPC() const { return instructions[current].address; }
+        inline u16 nextPC() const { return instructions[current].address + instructions[current].length; }
+        void sideExitIfZero() { sideExits.push_back({a.jcc(Equal), currentPC()}); }
+        void exitTo(std::vector<std::size_t>& jumps) { jumps.push_back(a.jmp()); }
+
+        Mem dynamicPage(bool write);
+        Mem memoryOperand(bool write);
+        void loadOperand();
+        void count(u32 cycles);
+        void finish(u32 cycles, std::optional<u16> target);
+        void branch(Mem flag, u16 mask, bool wide, bool takenIfSet);
+        bool compileInstruction();
+
+        Assembler& a;
+        const std::vector<JITInstruction>& instructions;
+        std::size_t current = 0;
+        u16 start;
+        std::size_t top = 0;
+        // jump and PC, which is stored before leaving the block
+        std::vector<std::pair<std::size_t, u16>> sideExits;
+        std::vector<std::pair<std::size_t, u16>> syncExits;
+        std::vector<std::size_t> normalExits;
+        std::vector<std::size_t> epilogueJumps;
+    };
+
+    // address is in eax, returns [page + offset], if page isn't direct - side exit
+    Mem BlockCompiler::dynamicPage(bool write) {
+        a.mov32(RCX, RAX);
+        a.shr(RCX, 8);
+        a.aluImm(And, RCX, 0xFF);
+        a.shl(RCX, 4);
+        a.mov64(RCX, Mem{write ? R11 : R10, RCX, 0});
+        a.test64(RCX);
+        sideExitIfZero();
+        a.aluImm(And, RAX, 0xFF);
+        return Mem{RCX, RAX, 0};
+    }
+
+    // address computation is the same as in makeInstruction(), including wrapping and reading of pointers
+    Mem BlockCompiler::memoryOperand(bool write) {
+        const JITInstruction& instruction = instructions[current];
+        u16 operand = instruction.operand;
+        switch(instruction.addrMode) {
+        case AddressationMode::ZeroPage:
+            return Mem{R9, NoIndex, operand};
+        case AddressationMode::ZeroPageX:
+        case AddressationMode::ZeroPageY:
+            a.movzx8(RAX, instruction.addrMode == AddressationMode::ZeroPageX ? RegX : RegY);
+            a.aluImm(Add, RAX, operand);
+            a.aluImm(And, RAX, 0xFF);
+            return Mem{R9, RAX, 0};
+        case AddressationMode::Absolute:
+            // RAM mirrors
+            if(operand < 0x2000) return Mem{R9, NoIndex, (u32)operand & 0x7FF};
+            a.mov64(RCX, Mem{write ? R11 : R10, NoIndex, (u32)(operand >> 8) * 16});
+            a.test64(RCX);
+            sideExitIfZero();
+            return Mem{RCX, NoIndex, (u32)operand & 0xFF};
+        case AddressationMode::AbsoluteX:
+        case AddressationMode::AbsoluteY:
+            a.movzx8(RAX, instruction.addrMode == AddressationMode::AbsoluteX ? RegX : RegY);
+            a.aluImm(Add, RAX, operand);
+            return dynamicPage(write);
+        case AddressationMode::IndexedIndirect:
+            // pointer address isn't wrapped to zero page, read16() takes bytes $FF and $100 as they are
+            a.movzx8(RCX, RegX);
+            a.aluImm(Add, RCX, operand);
+            a.movzx16(RAX, Mem{R9, RCX, 0});
+            return dynamicPage(write);
+        default:
+            // IndirectIndexed
+            a.movzx16(RAX, Mem{R9, NoIndex, operand});
+            a.movzx8(RCX, RegY);
+            a.aluReg(Add, RAX, RCX);
+            return dynamicPage(write);
+        }
+    }
+
+    // value goes to eax
+    void BlockCompiler::loadOperand() {
+        const JITInstruction& instruction = instructions[current];
+        if(instruction.addrMode == AddressationMode::Immediate) {
+            a.movImm32(RAX, instruction.operand & 0xFF);
+            return;
+        }
+        a.movzx8(RAX, memoryOperand(false));
+        // makeInstruction() compares low bytes of addresses, so "page is crossed" if index isn't zero
+        bool indexed = instruction.addrMode == AddressationMode::AbsoluteX || instruction.addrMode == AddressationMode::AbsoluteY
+                       || instruction.addrMode == AddressationMode::IndirectIndexed;
+        if(indexed && instruction.pageCrossCycles) {
+            a.alu8(Cmp, instruction.addrMode == AddressationMode::AbsoluteX ? RegX : RegY, 0);
+            std::size_t notCrossed = a.jcc(Equal);
+            a.aluImm(Add, R8, instruction.pageCrossCycles * 3, true);
+            a.bind(notCrossed, a.size());
+        }
+    }
+
+    void BlockCompiler::count(u32 cycles) {
+        a.aluImm(Add, R8, cycles * 3, true);
+        a.alu64(Add, Executed, 1);
+    }
+
+    // last instruction of the block: PC is already stored
+    void BlockCompiler::finish(u32 cycles, std::optional<u16> target) {
+        count(cycles);
+        if(target == start) {
+            a.cmp64(R8, SyncClock);
+            a.bind(a.jcc(Below), top);
+        }
+        exitTo(normalExits);
+    }
+
+    // branch is taken if flag & mask is non-zero(takenIfSet) or zero
+    void BlockCompiler::branch(Mem flag, u16 mask, bool wide, bool takenIfSet) {
+        const JITInstruction& instruction = instructions[current];
+        u16 target = instruction.address + 2 + (i8)instruction.operand;
+        if(wide) a.test16(flag, mask);
+        else a.test8(flag, mask);
+        std::size_t taken = a.jcc(takenIfSet ? NotEqual : Equal);
+        a.movImm16(RegPC, nextPC());
+        finish(instruction.cycles, nextPC());
+        a.bind(taken, a.size());
+        a.movImm16(RegPC, target);
+        // the same "page crossing" check as in CPU::branch()
+        finish(instruction.cycles + 1 + ((instruction.address & 255) != (target & 255)), target);
+    }
+
+
+    // returns true if instruction ends the block
+    bool BlockCompiler::compileInstruction() {
+        const JITInstruction& instruction = instructions[current];
+        // register or memory, which is changed by read-modify-write instruction
+        auto rmwTarget = [&] { return instruction.addrMode == AddressationMode::Accumulator ? RegA : memoryOperand(true); };
+        // transfer, increment and decrement of registers set N and Z
+        auto setRegister = [&](Mem reg) {
+            a.mov8(reg, RAX);
+            a.movzx8(RAX, RAX);
+            a.mov16(RegNZ, RAX);
+        };
+        switch(instruction.operation) {
+        case Operation::LDA: loadOperand(); a.mov8(RegA, RAX); a.mov16(RegNZ, RAX); break;
+        case Operation::LDX: loadOperand(); a.mov8(RegX, RAX); a.mov16(RegNZ, RAX); break;
+        case Operation::LDY: loadOperand(); a.mov8(RegY, RAX); a.mov16(RegNZ, RAX); break;
+        case Operation::STA:
+        case Operation::STX:
+        case Operation::STY: {
+            Mem target = memoryOperand(true);
+            a.movzx8(RDX, instruction.operation == Operation::STA ? RegA : instruction.operation == Operation::STX ? RegX : RegY);
+            a.mov8(target, RDX);
+            break;
+        }
+        case Operation::AND:
+        case Operation::ORA:
+        case Operation::EOR:
+            loadOperand();
+            a.movzx8(RCX, RegA);
+            a.aluReg(instruction.operation == Operation::AND ? And : instruction.operation == Operation::ORA ? Or : Xor, RCX, RAX);
+            a.mov8(RegA, RCX);
+            a.mov16(RegNZ, RCX);
+            break;
+        case Operation::BIT:
+            loadOperand();
+            // value bit 7 goes to bit 8 of nz, bit 6 - to V
+            a.movzx8(RCX, RegA);
+            a.aluReg(And, RCX, RAX);
+            a.mov32(RDX, RAX);
+            a.aluImm(And, RDX, 0x80);
+            a.shl(RDX, 1);
+            a.aluReg(Or, RCX, RDX);
+            a.mov16(RegNZ, RCX);
+            a.shr(RAX, 6);
+            a.aluImm(And, RAX, 1);
+            a.mov8(RegV, RAX);
+            break;
+        case Operation::CMP:
+        case Operation::CPX:
+        case Operation::CPY:
+            loadOperand();
+            a.movzx8(RCX, instruction.operation == Operation::CMP ? RegA : instruction.operation == Operation::CPX ? RegX : RegY);
+            a.aluReg(Cmp, RCX, RAX);
+            a.setcc(AboveEqual, RDX);
+            a.mov8(RegC, RDX);
+            a.aluReg(Sub, RCX, RAX);
+            a.movzx8(RCX, RCX);
+            a.mov16(RegNZ, RCX);
+            break;
+        case Operation::ADC:
+            loadOperand();
+            // result = A + value + C
+            a.movzx8(RCX, RegA);
+            a.movzx8(RDX, RegC);
+            a.aluReg(Add, RDX, RCX);
+            a.aluReg(Add, RDX, RAX);
+            // V = ~(A ^ value) & (A ^ result) & 0x80
+            a.aluReg(Xor, RAX, RCX);
+            a.not32(RAX);
+            a.aluReg(Xor, RCX, RDX);
+            a.aluReg(And, RAX, RCX);
+            a.test32(RAX, 0x80);
+            a.setcc(NotEqual, RAX);
+            a.mov8(RegV, RAX);
+            a.aluImm(Cmp, RDX, 0xFF);
+            a.setcc(Above, RAX);
+            a.mov8(RegC, RAX);
+            a.mov8(RegA, RDX);
+            a.movzx8(RDX, RDX);
+            a.mov16(RegNZ, RDX);
+            break;
+        case Operation::SBC:
+            loadOperand();
+            // result = A - value - !C
+            a.movzx8(RCX, RegA);
+            a.movzx8(RDX, RegC);
+            a.aluImm(Xor, RDX, 1);
+            a.neg32(RDX);
+            a.aluReg(Add, RDX, RCX);
+            a.aluReg(Sub, RDX, RAX);
+            // V = (A ^ result) & (~value ^ result) & 0x80
+            a.not32(RAX);
+            a.aluReg(Xor, RAX, RDX);
+            a.aluReg(Xor, RCX, RDX);
+            a.aluReg(And, RAX, RCX);
+            a.test32(RAX, 0x80);
+            a.setcc(NotEqual, RAX);
+            a.mov8(RegV, RAX);
+            // C is cleared on borrow(bit 8 of result)
+            a.test32(RDX, 0x100);
+            a.setcc(Equal, RAX);
+            a.mov8(RegC, RAX);
+            a.mov8(RegA, RDX);
+            a.movzx8(RDX, RDX);
+            a.mov16(RegNZ, RDX);
+            break;
+        case Operation::INC:
+        case Operation::DEC: {
+            Mem target = rmwTarget();
+            a.movzx8(RDX, target);
+            a.aluImm(instruction.operation == Operation::INC ? Add : Sub, RDX, 1);
+            a.mov8(target, RDX);
+            a.movzx8(RDX, RDX);
+            a.mov16(RegNZ, RDX);
+            break;
+        }
+        case Operation::ASL:
+        case Operation::ROL: {
+            Mem target = rmwTarget();
+            // bit 8 of shifted value is C
+            a.movzx8(RDX, target);
+            a.aluReg(Add, RDX, RDX);
+            if(instruction.operation == Operation::ROL) a.alu8(Or, RDX, RegC);
+            a.mov8(target, RDX);
+            a.mov32(RAX, RDX);
+            a.shr(RAX, 8);
+            a.mov8(RegC, RAX);
+            a.movzx8(RDX, RDX);
+            a.mov16(RegNZ, RDX);
+            break;
+        }
+        case Operation::LSR:
+        case Operation::ROR: {
+            Mem target = rmwTarget();
+            // C is shifted into bit 8, so it goes to bit 7, bit 0 goes to host carry
+            if(instruction.operation == Operation::ROR) {
+                a.movzx8(RDX, RegC);
+                a.shl(RDX, 8);
+                a.alu8(Or, RDX, target);
+            }
+            else a.movzx8(RDX, target);
+            a.shr(RDX, 1);
+            a.mov8(target, RDX);
+            a.setcc(Below, RAX);
+            a.mov8(RegC, RAX);
+            a.mov16(RegNZ, RDX);
+            break;
+        }
+        case Operation::INX: a.movzx8(RAX, RegX); a.aluImm(Add, RAX, 1); setRegister(RegX); break;
+        case Operation::INY: a.movzx8(RAX, RegY); a.aluImm(Add, RAX, 1); setRegister(RegY); break;
+        case Operation::DEX: a.movzx8(RAX, RegX); a.aluImm(Sub, RAX, 1); setRegister(RegX); break;
+        case Operation::DEY: a.movzx8(RAX, RegY); a.aluImm(Sub, RAX, 1); setRegister(RegY); break;
+        case Operation::TAX: a.movzx8(RAX, RegA); setRegister(RegX); break;
+        case Operation::TAY: a.movzx8(RAX, RegA); setRegister(RegY); break;
+        case Operation::TXA: a.movzx8(RAX, RegX); setRegister(RegA); break;
+        case Operation::TYA: a.movzx8(RAX, RegY); setRegister(RegA); break;
+        case Operation::TSX: a.movzx8(RAX, RegS); setRegister(RegX); break;
+        case Operation::TXS: a.movzx8(RAX, RegX); a.mov8(RegS, RAX); break;
+        case Operation::CLC: a.movImm8(RegC, 0); break;
+        case Operation::SEC: a.movImm8(RegC, 1); break;
+        case Operation::CLV: a.movImm8(RegV, 0); break;
+        case Operation::CLD: a.alu8(And, RegFlags, 0b11110111); break;
+        case Operation::SED: a.alu8(Or, RegFlags, 0b00001000); break;
+        case Operation::SEI: a.alu8(Or, RegFlags, 0b00000100); break;
+        case Operation::NOP: break;
+        // stack is page 1 of RAM: byte $100 + S, its wrapping is the same as of push()/top8()/top16()
+        case Operation::PHA:
+            a.movzx8(RAX, RegS);
+            a.movzx8(RDX, RegA);
+            a.mov8(Mem{R9, RAX, 0x100}, RDX);
+            a.alu8(Sub, RegS, 1);
+            break;
+        case Operation::PHP:
+            a.alu8(Or, RegFlags, 0b00100000);
+            // status(): flags | C | Z << 1 | V << 6 | N << 7
+            a.movzx8(RDX, RegFlags);
+            a.movzx8(RCX, RegC);
+            a.aluReg(Or, RDX, RCX);
+            a.movzx8(RCX, RegV);
+            a.shl(RCX, 6);
+            a.aluReg(Or, RDX, RCX);
+            a.test8(RegNZ, 0xFF);
+            a.setcc(Equal, RCX);
+            a.movzx8(RCX, RCX);
+            a.shl(RCX, 1);
+            a.aluReg(Or, RDX, RCX);
+            a.test16(RegNZ, 0x180);
+            a.setcc(NotEqual, RCX);
+            a.movzx8(RCX, RCX);
+            a.shl(RCX, 7);
+            a.aluReg(Or, RDX, RCX);
+            a.movzx8(RAX, RegS);
+            a.mov8(Mem{R9, RAX, 0x100}, RDX);
+            a.alu8(Sub, RegS, 1);
+            break;
+        case Operation::PLA:
+            a.movzx8(RAX, RegS);
+            a.movzx8(RAX, Mem{R9, RAX, 0x101});
+            a.alu8(Add, RegS, 1);
+            a.mov8(RegA, RAX);
+            a.mov16(RegNZ, RAX);
+            break;
+        case Operation::JSR:
+            // return address - 1 is written at $100 + S - 1
+            a.movzx8(RAX, RegS);
+            a.movImm16(Mem{R9, RAX, 0xFF}, instruction.address + 2);
+            a.alu8(Sub, RegS, 2);
+            a.movImm16(RegPC, instruction.operand);
+            finish(instruction.cycles, instruction.operand);
+            return true;
+        case Operation::RTS:
+            a.movzx8(RAX, RegS);
+            a.movzx16(RAX, Mem{R9, RAX, 0x101});
+            a.aluImm(Add, RAX, 1);
+            a.mov16(RegPC, RAX);
+            a.alu8(Add, RegS, 2);
+            finish(instruction.cycles, std::nullopt);
+            return true;
+        case Operation::JMP:
+            a.movImm16(RegPC, instruction.operand);
+            finish(instruction.cycles, instruction.operand);
+            return true;
+        // zero(): nz & 0xFF is 0, negative(): nz & 0x180 isn't 0
+        case Operation::BCC: branch(RegC, 0xFF, false, false); return true;
+        case Operation::BCS: branch(RegC, 0xFF, false, true); return true;
+        case Operation::BNE: branch(RegNZ, 0xFF, false, true); return true;
+        case Operation::BEQ: branch(RegNZ, 0xFF, false, false); return true;
+        case Operation::BPL: branch(RegNZ, 0x180, true, false); return true;
+        case Operation::BMI: branch(RegNZ, 0x180, true, true); return true;
+        case Operation::BVC: branch(RegV, 0xFF, false, false); return true;
+        case Operation::BVS: branch(RegV, 0xFF, false, true); return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    bool BlockCompiler::compile() {
+        if(!compilable(instructions[0])) return false;
+        a.mov64(RSI, Mem{RDI, NoIndex, offsetof(JITContext, registers)});
+        a.mov64(R9, Mem{RDI, NoIndex, offsetof(JITContext, ram)});
+        a.mov64(R10, Mem{RDI, NoIndex, offsetof(JITContext, readPages)});
+        a.mov64(R11, Mem{RDI, NoIndex, offsetof(JITContext, writePages)});
+        a.mov64(R8, Mem{RDI, NoIndex, offsetof(JITContext, clock)});
+        top = a.size();
+        bool finished = false;
+        for(current = 0; current < instructions.size() && !finished; ++current) {
+            if(!compilable(instructions[current])) {
+                a.movImm16(RegPC, currentPC());
+                a.movImm32(RAX, 1);
+                exitTo(epilogueJumps);
+                finished = true;
+            }
+            else if(compileInstruction()) finished = true;
+            else {
+                count(instructions[current].cycles);
+                // PPU should catch up and events should be processed after this instruction
+                a.cmp64(R8, SyncClock);
+                syncExits.push_back({a.jcc(AboveEqual), nextPC()});
+            }
+        }
+        // block has ended on its length limit or on bank window boundary
+        if(!finished) {
+            --current;
+            a.movImm16(RegPC, nextPC());
+            exitTo(normalExits);
+        }
+
+        for(auto& [jump, pc] : sideExits) {
+            a.bind(jump, a.size());
+            a.movImm16(RegPC, pc);
+            a.movImm32(RAX, 1);
+            exitTo(epilogueJumps);
+        }
+        for(auto& [jump, pc] : syncExits) {
+            a.bind(jump, a.size());
+            a.movImm16(RegPC, pc);
+            exitTo(normalExits);
+        }
+        for(std::size_t jump : normalExits) a.bind(jump, a.size());
+        a.movImm32(RAX, 0);
+        for(std::size_t jump : epilogueJumps) a.bind(jump, a.size());
+        a.mov64(Mem{RDI, NoIndex, offsetof(JITContext, clock)}, R8);
+        a.ret();
+        return true;
+    }
+
+    // changes protection of the pages, which contain [begin, end)
+    bool protect(u8* begin, u8* end, int protection) {
+        static const std::uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+        std::uintptr_t first = reinterpret_cast<std::uintptr_t>(begin) & ~(pageSize - 1);
+        std::uintptr_t last = (reinterpret_cast<std::uintptr_t>(end) + pageSize - 1) & ~(pageSize - 1);
+        return first == last || mprotect(reinterpret_cast<void*>(first), last - first, protection) == 0;
+    }
+}
+#endif
+
+JIT::JIT()
+    : code{nullptr}, used{0}, _epoch{1} {
+#ifdef JIT_NATIVE
+    // buffer is never writable and executable at the same time(see compile())
+    void* memory = mmap(nullptr, CodeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory != MAP_FAILED) code = static_cast<u8*>(memory);
+#endif
+}
+
+JIT::~JIT() {
+#ifdef JIT_NATIVE
+    if(code) munmap(code, CodeSize);
+#endif
+}
+
+NativeBlock JIT::compile(const std::vector<JITInstruction>& instructions) {
+#ifdef JIT_NATIVE
+    if(!code || instructions.empty()) return nullptr;
+    NativeBlock result = nullptr;
+    // second attempt is made in the empty buffer
+    for(int attempt = 0; attempt < 2; ++attempt) {
+        u8* block = code + used;
+        // pages are writable only while code is emitted, code before the block on its first page isn't executed meanwhile
+        if(!protect(block, code + CodeSize, PROT_READ | PROT_WRITE)) return nullptr;
+        Assembler assembler(block, code + CodeSize);
+        BlockCompiler compiler(assembler, instructions);
+        if(!compiler.compile()) break;
+        if(!assembler.overflow()) {
+            used = std::min(CodeSize, (used + assembler.size() + 15) & ~std::size_t(15));
+            result = reinterpret_cast<NativeBlock>(block);
+            break;
+        }
+        used = 0;
+        ++_epoch;
+    }
+    // all emitted code is executable, the rest of buffer stays writable
+    if(!protect(code, code + used, PROT_READ | PROT_EXEC)) return nullptr;
+    return result;
+#else
+    (void)instructions;
+#endif
+    return nullptr;
+}
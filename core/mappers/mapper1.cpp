@@ -1,8 +1,10 @@
 #include "core/include/mappers/mapper1.hpp"
+#include "core/include/snapshot.hpp"
+#include <cstring>
 #include <iostream>
 
 Mapper1::Mapper1(ROM& _rom, Logger* logger)
-    : MapperInterface(_rom, logger), rLoad{0}, rControl{0}, rChrBank0{0}, rChrBank1{0},
+    : MapperInterface(_rom, logger), rLoad{0}, writeCount{0}, rControl{0}, rChrBank0{0}, rChrBank1{0},
       rPrgBank{0}, prgBank0{0}, prgBank1{0}, prgBanks{rom.header()->PRGROMSize16Kb()},
       chrBank0{0}, chrBank1{0}
 {
@@ -10,8 +12,6 @@ Mapper1::Mapper1(ROM& _rom, Logger* logger)
 }
 
 std::optional<bool> Mapper1::write8(Address offset, u8 val) {
-    // 5 writes are needed to fill the shift register
-    static u8 writeCount = 0;
     if(!checkAddress(offset)) return std::nullopt;
     // write with bit 7 set clears the shift register
     if (val & 0b10000000) {
@@ -30,14 +30,23 @@ std::optional<bool> Mapper1::write8(Address offset, u8 val) {
             writeCount = 0;
             // which register to update is determined by bits 14 and 13 at the moment of 5th write
             u8 regNum = (offset & 0b110000000000000) >> 13;
+            // only what is affected by the written register is remapped(CHR banks are often switched mid-frame)
             switch (regNum) {
-            case 0: rControl = rLoad; break;
-            case 1: rChrBank0 = rLoad; break;
-            case 2: rChrBank1 = rLoad; break;
-            case 3: rPrgBank = rLoad; break;
+            case 0: {
+                u8 changed = rControl ^ rLoad;
+                rControl = rLoad;
+                // mirroring is taken from the header until control is written, so it is always compared
+                fixMirroring();
+                if(changed & 0b1100) fixPRGBanks();
+                if(changed & 0b10000) fixCHRBanks();
+                break;
+            }
+            case 1: rChrBank0 = rLoad; fixCHRBanks(); break;
+            // CHR bank 1 is ignored in 8 KB mode
+            case 2: rChrBank1 = rLoad; if(rControl & 0b10000) fixCHRBanks(); break;
+            case 3: rPrgBank = rLoad; fixPRGBanks(); break;
             }
             rLoad = 0;
-            fix();
         }
     }
     return true;
@@ -49,28 +58,37 @@ Serialization::BytesCount Mapper1::serialize(std::string &buf) {
 }
 
 Serialization::BytesCount Mapper1::deserialize(const std::string &buf, Serialization::BytesCount offset) {
-    return Serialization::Deserializer::deserializeAll(buf, offset, &rLoad, &rControl, &rChrBank0, &rChrBank1, &rPrgBank, &prgBank0, &prgBank1, &prgBanks, &chrBank0, &chrBank1);
-}
-
-bool Mapper1::checkAddress(Address address) const {
-    // if PRG RAM is used, read/write should be processed by 'memory'
-    return address >= 0x8000;
+    auto res = Serialization::Deserializer::deserializeAll(buf, offset, &rLoad, &rControl, &rChrBank0, &rChrBank1, &rPrgBank, &prgBank0, &prgBank1, &prgBanks, &chrBank0, &chrBank1);
+    fixMirroring();
+    mapPRGBanks();
+    mapCHRBanks();
+    return res;
 }
 
-Address Mapper1::addressFix(Address address) const {
-    bool usingBank0 = address < 0xC000;
-    if (usingBank0) return (prgBank0 * PRG_BANK_SIZE) + (address - 0x8000);
-    else return (prgBank1 * PRG_BANK_SIZE) + (address - 0xC000);
+// snapshot
+namespace {
+    struct Mapper1Registers {
+        u8 rLoad, writeCount, rControl, rChrBank0, rChrBank1, rPrgBank, prgBank0, prgBank1, prgBanks, chrBank0, chrBank1;
+    };
 }
 
-bool Mapper1::checkCHRAddress(Address address) const {
-    return address < 0x2000;
+void Mapper1::saveState(MapperState& state) const {
+    MapperInterface::saveState(state);
+    Mapper1Registers regs{rLoad, writeCount, rControl, rChrBank0, rChrBank1, rPrgBank, prgBank0, prgBank1, prgBanks, chrBank0, chrBank1};
+    static_assert(sizeof(regs) <= sizeof(state.registers), "Mapper1 registers don't fit into snapshot");
+    std::memcpy(state.registers.data(), &regs, sizeof(regs));
 }
 
-Address Mapper1::addressCHRFix(Address address) const {
-    bool usingBank0 = address < 0x1000;
-    if (usingBank0) return (chrBank0 * CHR_BANK_SIZE) + address;
-    else return (chrBank1 * CHR_BANK_SIZE) + (address - 0x1000);
+void Mapper1::loadState(const MapperState& state) {
+    MapperInterface::loadState(state);
+    Mapper1Registers regs;
+    std::memcpy(&regs, state.registers.data(), sizeof(regs));
+    rLoad = regs.rLoad; writeCount = regs.writeCount; rControl = regs.rControl;
+    rChrBank0 = regs.rChrBank0; rChrBank1 = regs.rChrBank1; rPrgBank = regs.rPrgBank;
+    prgBank0 = regs.prgBank0; prgBank1 = regs.prgBank1; prgBanks = regs.prgBanks; chrBank0 = regs.chrBank0; chrBank1 = regs.chrBank1;
+    fixMirroring();
+    mapPRGBanks();
+    mapCHRBanks();
 }
 
 // initial mode is mode 3 (?)
@@ -79,12 +97,6 @@ void Mapper1::initPRGBanks() {
     fixPRGBanks();
 }
 
-void Mapper1::fix() {
-    fixMirroring();
-    fixCHRBanks();
-    fixPRGBanks();
-}
-
 void Mapper1::fixPRGBanks() {
     u8 prgBankMode = getPrgRomBankMode();
     if((prgBankMode == 0 || prgBankMode) == 1 && (rPrgBank & 0b10000)) logger->log(LogLevel::Warning, "Attempt to select PRG ROM bank with bit 4");
@@ -104,6 +116,7 @@ void Mapper1::fixPRGBanks() {
         prgBank1 = prgBanks - 1;
         break;
     }
+    mapPRGBanks();
 }
 
 void Mapper1::fixCHRBanks() {
@@ -118,13 +131,28 @@ void Mapper1::fixCHRBanks() {
         chrBank0 = rChrBank0;
         chrBank1 = rChrBank1;
     }
+    mapCHRBanks();
 }
 
 void Mapper1::fixMirroring() {
+    Mirroring oldMirroring = _mirroring;
     switch(rControl & 0b11) {
     case 0: _mirroring = Mirroring::OneScreenLower; break;
     case 1: _mirroring = Mirroring::OneScreenUpper; break;
     case 2: _mirroring = Mirroring::Vertical; break;
     case 3: _mirroring = Mirroring::Horizontal; break;
     }
+    if(_mirroring != oldMirroring) notify((int)MapperEvent::MirroringChanged);
+}
+
+void Mapper1::mapPRGBanks() {
+    mapPRG16k(0, prgBank0);
+    mapPRG16k(1, prgBank1);
+    notify((int)MapperEvent::PRGBanksSwitched);
+}
+
+void Mapper1::mapCHRBanks() {
+    mapCHR4k(0, chrBank0);
+    mapCHR4k(1, chrBank1);
+    notify((int)MapperEvent::CHRBanksSwitched);
 }
@@ -0,0 +1,158 @@
+#include "core/include/mappers/mapper4.hpp"
+#include "core/include/snapshot.hpp"
+#include <cstring>
+
+Mapper4::Mapper4(ROM& _rom, Logger* logger)
+    : MapperInterface(_rom, logger), rBankSelect{0}, rBanks{0, 2, 4, 5, 6, 7, 0, 1}, rMirroring{0}, rIrqLatch{0},
+      irqCounter{0}, irqReload{false}, irqEnabled{false}, irqAsserted{false}
+{
+    scanlineCounter = true;
+    // four-screen mirroring isn't supported, so header's mirroring is kept until the first write to $A000
+    rMirroring = _mirroring == Mirroring::Horizontal ? 1 : 0;
+    fixPRGBanks();
+    fixCHRBanks();
+}
+
+/*
+    Registers are selected by address range and its lowest bit:
+        $8000 - bank select, $8001 - bank data;
+        $A000 - mirroring, $A001 - PRG-RAM protect(PRG-RAM is always enabled here);
+        $C000 - IRQ latch, $C001 - IRQ reload;
+        $E000 - IRQ disable(and acknowledge), $E001 - IRQ enable.
+*/
+std::optional<bool> Mapper4::write8(Address offset, u8 val) {
+    if(!checkAddress(offset)) return std::nullopt;
+    bool odd = offset & 1;
+    switch(offset & 0xE000) {
+    case 0x8000:
+        // only the side, which is affected by the write, is remapped(CHR banks are often switched mid-frame)
+        if(odd) {
+            u8 bank = rBankSelect & 0b111;
+            rBanks[bank] = val;
+            if(bank < 6) fixCHRBanks();
+            else fixPRGBanks();
+        }
+        else {
+            u8 changed = rBankSelect ^ val;
+            rBankSelect = val;
+            if(changed & 0b1000000) fixPRGBanks();
+            if(changed & 0b10000000) fixCHRBanks();
+        }
+        break;
+    case 0xA000:
+        if(!odd) {
+            rMirroring = val & 1;
+            fixMirroring();
+        }
+        break;
+    case 0xC000:
+        if(odd) {
+            irqCounter = 0;
+            irqReload = true;
+        }
+        else rIrqLatch = val;
+        notify((int)MapperEvent::ScanlineCounterChanged);
+        break;
+    case 0xE000:
+        irqEnabled = odd;
+        if(!odd) setIRQ(false, 0);
+        notify((int)MapperEvent::ScanlineCounterChanged);
+        break;
+    }
+    return true;
+}
+
+void Mapper4::clockScanlineCounter(u64 clock) {
+    if(irqCounter == 0 || irqReload) {
+        irqCounter = rIrqLatch;
+        irqReload = false;
+    }
+    else --irqCounter;
+    if(irqCounter == 0 && irqEnabled) setIRQ(true, clock);
+}
+
+u32 Mapper4::scanlineIRQDistance() const {
+    if(!irqEnabled) return 0;
+    // on the next clock counter is reloaded
+    if(irqCounter == 0 || irqReload) return rIrqLatch + 1;
+    return irqCounter;
+}
+
+void Mapper4::setIRQ(bool val, u64 clock) {
+    irqAsserted = val;
+    if(!eventQueue) return;
+    if(val) eventQueue->post(EventType::IRQMapper, clock);
+    else eventQueue->release(EventType::IRQMapper);
+}
+
+// serialization
+Serialization::BytesCount Mapper4::serialize(std::string &buf) {
+    return Serialization::Serializer::serializeAll(buf, &rBankSelect, &rBanks, &rMirroring, &rIrqLatch, &irqCounter, &irqReload, &irqEnabled, &irqAsserted);
+}
+
+Serialization::BytesCount Mapper4::deserialize(const std::string &buf, Serialization::BytesCount offset) {
+    auto banksWr = wrapArr(rBanks);
+    auto res = Serialization::Deserializer::deserializeAll(buf, offset, &rBankSelect, &banksWr, &rMirroring, &rIrqLatch, &irqCounter, &irqReload, &irqEnabled, &irqAsserted);
+    fixMirroring();
+    fixPRGBanks();
+    fixCHRBanks();
+    // IRQ line is a part of mapper's state
+    setIRQ(irqAsserted, 0);
+    notify((int)MapperEvent::ScanlineCounterChanged);
+    return res;
+}
+
+// snapshot
+namespace {
+    struct Mapper4Registers {
+        u8 rBankSelect;
+        std::array<u8, 8> rBanks;
+        u8 rMirroring, rIrqLatch, irqCounter;
+        bool irqReload, irqEnabled, irqAsserted;
+    };
+}
+
+void Mapper4::saveState(MapperState& state) const {
+    MapperInterface::saveState(state);
+    Mapper4Registers regs{rBankSelect, rBanks, rMirroring, rIrqLatch, irqCounter, irqReload, irqEnabled, irqAsserted};
+    static_assert(sizeof(regs) <= sizeof(state.registers), "Mapper4 registers don't fit into snapshot");
+    std::memcpy(state.registers.data(), &regs, sizeof(regs));
+}
+
+void Mapper4::loadState(const MapperState& state) {
+    MapperInterface::loadState(state);
+    Mapper4Registers regs;
+    std::memcpy(&regs, state.registers.data(), sizeof(regs));
+    rBankSelect = regs.rBankSelect; rBanks = regs.rBanks; rMirroring = regs.rMirroring; rIrqLatch = regs.rIrqLatch;
+    irqCounter = regs.irqCounter; irqReload = regs.irqReload; irqEnabled = regs.irqEnabled;
+    fixMirroring();
+    fixPRGBanks();
+    fixCHRBanks();
+    setIRQ(regs.irqAsserted, 0);
+    notify((int)MapperEvent::ScanlineCounterChanged);
+}
+
+void Mapper4::fixPRGBanks() {
+    // bit 6 of bank select swaps $8000 and $C000
+    bool swapped = rBankSelect & 0b1000000;
+    mapPRG8k(swapped ? 2 : 0, rBanks[6]);
+    mapPRG8k(1, rBanks[7]);
+    mapPRG8k(swapped ? 0 : 2, -2);
+    mapPRG8k(3, -1);
+    notify((int)MapperEvent::PRGBanksSwitched);
+}
+
+void Mapper4::fixCHRBanks() {
+    // bit 7 of bank select swaps $0000-$0FFF and $1000-$1FFF
+    u8 inversion = (rBankSelect & 0b10000000) ? 4 : 0;
+    // 2 KB banks ignore the lowest bit
+    mapCHR2k((0 ^ inversion) / 2, rBanks[0] >> 1);
+    mapCHR2k((2 ^ inversion) / 2, rBanks[1] >> 1);
+    for(u8 i = 0; i < 4; ++i) mapCHR1k((4 + i) ^ inversion, rBanks[2 + i]);
+    notify((int)MapperEvent::CHRBanksSwitched);
+}
+
+void Mapper4::fixMirroring() {
+    _mirroring = rMirroring ? Mirroring::Horizontal : Mirroring::Vertical;
+    notify((int)MapperEvent::MirroringChanged);
+}
@@ -1,11 +1,27 @@
 #include "core/include/mappers/mapperinterface.hpp"
+#include "core/include/snapshot.hpp"
+#include <algorithm>
 
+// if ROM has no CHR, mapper uses 8 KB of CHR-RAM
 MapperInterface::MapperInterface(ROM& _rom, Logger* _logger)
-    : rom{_rom}, logger{_logger}, _mirroring{rom.header()->mirroring()} {}
+    : rom{_rom}, logger{_logger}, _mirroring{rom.header()->mirroring()}, eventQueue{nullptr}, scanlineCounter{false}, chrRAM{rom.CHRROM().empty()}, prgWindows{}, chrWindows{} {
+    if(chrRAM) rom.CHRROM().resize(0x2000);
+    mapPRG32k(0);
+    mapCHR8k(0);
+}
+
+void MapperInterface::_mapBank(Address* windows, u8 first, u8 count, Address windowSize, int bank, std::size_t size) {
+    Address bankSize = windowSize * count;
+    int banks = std::max<int>(size / bankSize, 1);
+    bank %= banks;
+    if(bank < 0) bank += banks;
+    // bank bigger than ROM(32 KB of 16 KB NROM) is mirrored
+    for(u8 i = 0; i < count; ++i) windows[first + i] = (bank * bankSize + i * windowSize) % std::max<std::size_t>(size, windowSize);
+}
 
 std::optional<u8> MapperInterface::read8(Address offset) {
     if(!checkAddress(offset)) return std::nullopt;
-    return rom.PRGROM()[addressFix(offset)];
+    return rom.PRGROM()[prgOffset(offset)];
 }
 
 std::optional<bool> MapperInterface::write8(Address offset, u8 val) {
@@ -13,14 +29,15 @@ std::optional<bool> MapperInterface::write8(Address offset, u8 val) {
 #ifdef DEBUG
     if(logger) logger->log(LogLevel::Warning, "PRG-ROM writing attempt at " + std::to_string(offset) + " with value " + std::to_string(val));
 #endif
-    rom.PRGROM()[addressFix(offset)] = val;
+    rom.PRGROM()[prgOffset(offset)] = val;
+    notify((int)MapperEvent::PRGROMWritten);
     return true;
 }
 
 std::optional<u16> MapperInterface::read16(Address offset) {
     if(!checkAddress(offset)) return std::nullopt;
-    Address fixedAddress = addressFix(offset);
-    return read16Contigous(rom.PRGROM(), fixedAddress);
+    // bytes can be in different windows
+    return rom.PRGROM()[prgOffset(offset)] + (rom.PRGROM()[prgOffset(0x8000 | ((offset + 1) & 0x7FFF))] << 8);
 }
 
 std::optional<bool> MapperInterface::write16(Address offset, u16 val) {
@@ -28,21 +45,36 @@ std::optional<bool> MapperInterface::write16(Address offset, u16 val) {
 #ifdef DEBUG
     if(logger) logger->log(LogLevel::Warning, "PRG-ROM writing16 attempt at " + std::to_string(offset) + " with value " + std::to_string(val));
 #endif
-    Address fixedAddress = addressFix(offset);
-    write16Contigous(rom.PRGROM(), fixedAddress, val);
+    rom.PRGROM()[prgOffset(offset)] = (u8)(val & 0xff);
+    rom.PRGROM()[prgOffset(0x8000 | ((offset + 1) & 0x7FFF))] = (u8)((val & 0xff00) >> 8);
+    notify((int)MapperEvent::PRGROMWritten);
     return true;
 }
 
 std::optional<u8> MapperInterface::readCHR(Address offset) {
     if(!checkCHRAddress(offset)) return std::nullopt;
-    return rom.CHRROM()[addressCHRFix(offset)];
+    return rom.CHRROM()[chrOffset(offset)];
 }
 
 std::optional<bool> MapperInterface::writeCHR(Address offset, u8 val) {
     if(!checkCHRAddress(offset)) return std::nullopt;
+    // CHR-ROM isn't writable(and isn't saved in snapshots)
+    if(!chrRAM) {
 #ifdef DEBUG
-    if(logger) logger->log(LogLevel::Warning, "CHR-ROM writing attempt at " + std::to_string(offset) + " with value " + std::to_string(val));
+        if(logger) logger->log(LogLevel::Warning, "CHR-ROM writing attempt at " + std::to_string(offset) + " with value " + std::to_string(val));
 #endif
-    rom.CHRROM()[addressCHRFix(offset)] = val;
+        return true;
+    }
+    rom.CHRROM()[chrOffset(offset)] = val;
     return true;
 }
+
+void MapperInterface::saveState(MapperState& state) const {
+    if(chrRAM) std::copy(rom.CHRROM().begin(), rom.CHRROM().end(), state.chrRAM.begin());
+}
+
+void MapperInterface::loadState(const MapperState& state) {
+    if(!chrRAM) return;
+    std::copy(state.chrRAM.begin(), state.chrRAM.end(), rom.CHRROM().begin());
+    notify((int)MapperEvent::CHRRAMLoaded);
+}
@@ -3,14 +3,25 @@
 
 // - value-initializing memory(init with zeros)
 Memory::Memory(MapperInterface& _mapper, PPU& _ppu, StandardController& _contr1, StandardController& _contr2)
-    : memory{}, mapper{_mapper}, ppu{_ppu}, stController1{_contr1}, stController2{_contr2} {}
+    : memory{}, readPages{}, writePages{}, mapper{_mapper}, ppu{_ppu}, stController1{_contr1}, stController2{_contr2} {
+    _mapPages();
+    mapper.attach(this);
+}
 
-u8 Memory::read8(Address offset) {
-    auto optionalRes = mapper.read8(offset);
-    if(optionalRes) return optionalRes.value();
-    offset = _mirrorAddressFix(offset);
+Memory::~Memory() {
+    mapper.detach(this);
+}
+
+void Memory::update(MapperInterface*, int eventType) {
+    if(eventType == (int)MapperEvent::PRGBanksSwitched) _mapPRGPages();
+}
+
+u8 Memory::_readHandler(Address offset) {
+    offset = _mirrorAddressFix(offset & 0xFFFF);
     // ppu
     if(isInPPURegisters(offset)) {
+        // PPU runs lazily, so it should catch up with CPU before its registers are accessed
+        ppu.catchUp();
         auto& ppuregs = ppu.accessPPURegisters();
         switch(offset) {
         case 0x2000: return ppuregs.readPpuctrl();
@@ -31,41 +42,45 @@ u8 Memory::read8(Address offset) {
     return memory[offset];
 }
 
-Memory& Memory::write8(Address offset, u8 val) {
-    auto optionalRes = mapper.write8(offset, val);
-    if(optionalRes) return *this;
+void Memory::_writeHandler(Address offset, u8 val) {
+    offset &= 0xFFFF;
+    if(writePages[offset >> 8].handler == PageHandler::Mapper) {
+        // mapper can switch CHR banks or mirroring, so everything before this write should be rendered with old ones
+        ppu.catchUp();
+        mapper.write8(offset, val);
+        return;
+    }
     offset = _mirrorAddressFix(offset);
     // ppu
     if(isInPPURegisters(offset)) {
+        ppu.catchUp();
         auto& ppuregs = ppu.accessPPURegisters();
         switch(offset) {
-        case 0x2000: ppuregs.writePpuctrl(val); return *this;
-        case 0x2001: ppuregs.writePpumask(val); return *this;
-        case 0x2002: ppuregs.writePpustatus(val); return *this;
-        case 0x2003: ppuregs.writeOamaddr(val); return *this;
-        case 0x2004: ppuregs.writeOamdata(val); return *this;
-        case 0x2005: ppuregs.writePpuscroll(val); return *this;
-        case 0x2006: ppuregs.writePpuaddr(val); return *this;
-        case 0x2007: ppuregs.writePpudata(val); return *this;
-        case 0x4014: ppuregs.writeOamdma(val); return *this;
+        case 0x2000: ppuregs.writePpuctrl(val); return;
+        case 0x2001: ppuregs.writePpumask(val); return;
+        case 0x2002: ppuregs.writePpustatus(val); return;
+        case 0x2003: ppuregs.writeOamaddr(val); return;
+        case 0x2004: ppuregs.writeOamdata(val); return;
+        case 0x2005: ppuregs.writePpuscroll(val); return;
+        case 0x2006: ppuregs.writePpuaddr(val); return;
+        case 0x2007: ppuregs.writePpudata(val); return;
+        case 0x4014: ppuregs.writeOamdma(val); return;
         }
     }
     // controllers
     else if (offset == 0x4016) {
         if (val == 0) stController1.strobe(val);
         else if (val == 1) stController2.strobe(val);
-        return *this;
-    }
-    if(offset >= 0x6000 && offset < 0x8000) {
-        int i = 0;
-        i += 1;
+        return;
     }
     // others
     memory[offset] = val;
-    return *this;
 }
 
+// reading 16 bit values directly if both bytes are on the same page, else - as before page table(without side effects)
 u16 Memory::read16(Address offset) {
+    const MemoryPage& page = readPages[(offset >> 8) & 0xFF];
+    if(page.data && (offset & 0xFF) != 0xFF) return read16Contigous(page.data, offset & 0xFF);
     auto optionalRes = mapper.read16(offset);
     if(optionalRes) return optionalRes.value();
     Address fixedAddress = _mirrorAddressFix(offset);
@@ -73,6 +88,11 @@ u16 Memory::read16(Address offset) {
 }
 
 Memory& Memory::write16(Address offset, u16 val) {
+    const MemoryPage& page = writePages[(offset >> 8) & 0xFF];
+    if(page.data && (offset & 0xFF) != 0xFF) {
+        write16Contigous(page.data, offset & 0xFF, val);
+        return *this;
+    }
     auto optionalRes = mapper.write16(offset, val);
     if(optionalRes) return *this;
     Address fixedAddress = _mirrorAddressFix(offset);
@@ -80,6 +100,34 @@ Memory& Memory::write16(Address offset, u16 val) {
     return *this;
 }
 
+/*
+    Memory map:
+        $0000-$07FF - RAM, mirrored on $0800-$1FFF
+        $2000-$3FFF - PPU registers(8 registers, mirrored)
+        $4000-$40FF - IO registers(OAMDMA, controllers, APU)
+        $4100-$7FFF - cartridge space and PRG-RAM
+        $8000-$FFFF - PRG-ROM, mapped by mapper
+*/
+void Memory::_mapPages() {
+    for(int page = 0; page < 0x80; ++page) {
+        MemoryPage memPage{nullptr, PageHandler::Direct};
+        if(page < 0x20) memPage.data = &memory[(page % 8) << 8];
+        else if(page < 0x40) memPage.handler = PageHandler::PPURegisters;
+        else if(page == 0x40) memPage.handler = PageHandler::IORegisters;
+        else memPage.data = &memory[page << 8];
+        readPages[page] = writePages[page] = memPage;
+    }
+    _mapPRGPages();
+}
+
+// should be called every time mapper switches PRG banks
+void Memory::_mapPRGPages() {
+    for(int page = 0x80; page < 0x100; ++page) {
+        readPages[page] = MemoryPage{mapper.prgPage(page << 8), PageHandler::Direct};
+        writePages[page] = MemoryPage{nullptr, PageHandler::Mapper};
+    }
+}
+
 /*
    Fix address, considering mirroring, for read/write operations.
    For example, PPU registers are stored at $2000 through $2007, and mirrored from $2008 through $3FFF, so a write to $3456 is the same as a write to $2006.
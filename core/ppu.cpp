@@ -1,6 +1,10 @@
 #include <cstring>
 #include <iostream>
 #include "include/ppu.hpp"
+#include "include/snapshot.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 PPURegisters::PPURegisters()
     : ppuctrl{0}, ppumask{0}, ppustatus{0}, oamaddr{0}, ppuscroll{0}, ppuaddr{0}, ppudata{0} {}
@@ -11,12 +15,21 @@ PPURegistersAccess::PPURegistersAccess(PPU &_ppu)
 PPURegistersAccess& PPURegistersAccess::writePpuctrl(u8 val) {
     // if setting NMI flag, and in vblank, generate NMI
     if ((ppuRegisters.ppustatus & 0b10000000) && (val & 0b10000000) && !(ppuRegisters.ppuctrl & 0b10000000)) {
-        ppu.eventQueue.get().push(EventType::InterruptNMI);
+        ppu.eventQueue.post(EventType::InterruptNMI, ppu.clock);
     }
     // writing base nametable address to ppu's register t
     ppuRegisters.ppuctrl = val;
     ppu.t ^= (ppu.t & 0b110000000000);
     ppu.t |= (val & 0b11) << 10;
+    // pattern tables define A12 rises
+    if(ppu.mapper.hasScanlineCounter()) ppu._updateNextSyncClock();
+    return *this;
+}
+
+PPURegistersAccess& PPURegistersAccess::writePpumask(u8 val) {
+    ppuRegisters.ppumask = val;
+    // there are no A12 rises without rendering
+    if(ppu.mapper.hasScanlineCounter()) ppu._updateNextSyncClock();
     return *this;
 }
 
@@ -95,20 +108,18 @@ PPURegistersAccess& PPURegistersAccess::writePpudata(u8 val) {
 }
 
 u8 PPURegistersAccess::readPpudata() const {
-    // internal buffer
-    static u8 buf;
     u8 readData = ppu.memory.read(ppu.v & ppu.AccessAddressMask);
     // when reading from before palettes, return data from internal buffer, but update it
     if(ppu.v < 0x3F00) {
-        u8 res = buf;
-        buf = readData;
+        u8 res = ppu.readBuffer;
+        ppu.readBuffer = readData;
         ppu.v += readPpuctrlVramIncrement() ? 32 : 1;
         return res;
     }
     // reading here works differently - updating buffer AND returning currently read data
     else {
         // palette
-        buf = readData;
+        ppu.readBuffer = readData;
         ppu.v += readPpuctrlVramIncrement() ? 32 : 1;
         return readData;
     }
@@ -116,15 +127,28 @@ u8 PPURegistersAccess::readPpudata() const {
 
 PPURegistersAccess& PPURegistersAccess::writeOamdma(u8 val) {
     ppuRegisters.oamdma = val;
-    ppu.eventQueue.get().push(EventType::OAMDMAWrite);
+    ppu.eventQueue.post(EventType::OAMDMAWrite, ppu.clock);
     return *this;
 }
 
 PPU::PPU(PPUMemory& _memory, EventQueue& _eventQueue, Logger* _logger)
-    : Observable(), ppuRegisters{*this}, memory{_memory}, eventQueue{_eventQueue}, logger{_logger}, v{0}, t{0}, x{0}, w{0},
+    : Observable(), ppuRegisters{*this}, memory{_memory}, mapper{_memory.getMapper()}, eventQueue{_eventQueue}, logger{_logger}, v{0}, t{0}, x{0}, w{0},
       patternDataShifts16{}, attrDataShifts8{}, attrDataLatches{}, ntByte{}, attrByte{}, lowBgByte{}, highBgByte{},
-      OAM{}, secondaryOAM{}, ppuMap{}, spritesPatternDataShifts8{}, spriteAttributeBytes{}, spriteXCounters{}, spriteLowPatternByte{0}, spriteHighPatternByte{0},
-      frame{0}, scanline{-1}, cycle{0}, drawDebugGrid{false}, frameQueue{} {}
+      OAM{}, secondaryOAM{}, ppuMap{}, lineBckg{}, lineSprites{}, lineSpritesMask{}, spritesPatternDataShifts8{}, spriteAttributeBytes{}, spriteXCounters{}, spriteLowPatternByte{0}, spriteHighPatternByte{0},
+      lowBgByteAddr{0}, spritePatternAddr{0}, readBuffer{0},
+      spriteEvalM{0}, spriteEvalN{0}, spriteEvalSlot{0},
+      frame{0}, scanline{-1}, cycle{0}, drawDebugGrid{false}, scanlineRendering{true}, renderFrame{true}, renderNextFrame{true}, clock{0}, masterClock{0}, nextSyncClock{0}, frameQueue{} {
+    _updateNextSyncClock();
+    mapper.attach(this);
+}
+
+PPU::~PPU() {
+    mapper.detach(this);
+}
+
+void PPU::update(MapperInterface*, int eventType) {
+    if(eventType == (int)MapperEvent::ScanlineCounterChanged) _updateNextSyncClock();
+}
 
 void PPU::step() {
     switch(scanline) {
@@ -133,6 +157,7 @@ void PPU::step() {
         case 240: postRender(); break;
         case 241 ... 260: verticalBlank(); break;
     }
+    if((cycle == 260 || cycle == 324) && scanline < 240 && mapper.hasScanlineCounter() && cycle == _a12RiseCycle()) mapper.clockScanlineCounter(clock);
     // each scanline consists of exactly 341 cycles
     ++cycle;
     if (cycle == 341) {
@@ -149,12 +174,147 @@ void PPU::step() {
         scanline = -1;
         cycle = 0;
         ++frame;
+        renderFrame = renderNextFrame;
+    }
+}
+
+/*
+    If the whole scanline fits before the master clock, CPU can't access PPU in the middle of it(any access catches up first),
+    so the scanline is rendered at once without per-dot dispatching. Otherwise PPU goes dot by dot.
+*/
+void PPU::_catchUp() {
+    while(clock < masterClock) {
+        if(scanlineRendering && cycle == 0 && scanline != 241 && clock + _scanlineLength() <= masterClock) {
+            if(scanline < 240) _renderScanline();
+            _nextScanline();
+        }
+        else {
+            step();
+            ++clock;
+        }
+    }
+    _updateNextSyncClock();
+}
+
+// odd frames skip the last cycle of prerender scanline
+u16 PPU::_scanlineLength() const {
+    return (scanline == -1 && (frame % 2)) ? 340 : 341;
+}
+
+void PPU::_nextScanline() {
+    clock += _scanlineLength();
+    cycle = 0;
+    ++scanline;
+    if (scanline == 260) {
+        scanline = -1;
+        ++frame;
+        renderFrame = renderNextFrame;
+    }
+}
+
+/*
+    Same work as step() does for dots 1-340 of prerender or visible scanline, in the same order, but grouped by dot ranges.
+    Sprite 0 hit is set on the same dot as in step(). Sprites for the next scanline are evaluated at once on dot 65,
+        overflow is set then, if step() would set it on any dot of the scanline(CPU can't see the difference).
+*/
+void PPU::_renderScanline() {
+    const bool visible = scanline >= 0;
+    // nothing can change PPUMASK in the middle of the scanline, so it is read once
+    const u8 ppumask = ppuRegisters.ppuRegisters.ppumask;
+    // background fetching and drawing, sprite evaluation for the next scanline
+    for(cycle = 1; cycle <= 256; ++cycle) {
+        if(!visible && cycle == 1) ppuRegisters.writePpustatusVblank(0).writePpustatusSprite0Hit(0).writePpustatusSpriteOverflow(0);
+        // bytes are fetched only on even dots
+        if(!(cycle & 1)) _renderInternalFetchByte();
+        if(visible && cycle >= 2) {
+            drawBackgroundPixel(cycle - 2, ppumask);
+            _renderInternalBckgShifts();
+            if(((cycle - 1) & 7) == 0) _renderInternalFedRegisters();
+        }
+        if(cycle <= 64) _spriteEvaluateClearSecondaryOAM();
+        else if(cycle == 65) _spriteEvaluateScanline();
+    }
+    // last background pixel
+    _restoreXScrollFromT();
+    if(visible) {
+        drawBackgroundPixel(255, ppumask);
+        _renderInternalBckgShifts();
+        _renderInternalFedRegisters();
+    }
+    _spriteEvaluateFetchData();
+    ppuRegisters.writeOamaddr(0);
+    // sprites fetching and drawing
+    for(cycle = 258; cycle <= 320; ++cycle) {
+        if(!visible && cycle >= 280 && cycle <= 304) _restoreYScrollFromT();
+        _spriteEvaluateFetchData();
+        ppuRegisters.writeOamaddr(0);
+        if(visible) drawSpritePixel();
+        if(cycle >= 265 && ((cycle - 1) & 7) == 0) _spriteEvaluateFedData();
+    }
+    if(visible) _composeScanline();
+    // first two tiles of the next scanline
+    _renderInternalFetchByte();
+    _spriteEvaluateFedData();
+    for(cycle = 322; cycle <= 337; ++cycle) {
+        if(cycle <= 336) _renderInternalFetchByte();
+        if(cycle > 329) _renderInternalBckgShifts();
+        if(cycle == 329 || cycle == 337) _renderInternalFedRegisters();
+    }
+    if(mapper.hasScanlineCounter()) {
+        if(u16 riseCycle = _a12RiseCycle()) mapper.clockScanlineCounter(clock + riseCycle);
+    }
+}
+
+/*
+    Events that CPU should not miss: vblank start(NMI, new frame for renderer) at scanline 241 cycle 1 and frame end at scanline 259 cycle 340.
+    Position is counted from the start of prerender scanline, which is 1 cycle shorter on odd frames.
+    Sync is needed when master clock passes the event cycle.
+*/
+void PPU::_updateNextSyncClock() {
+    auto position = [this](i16 line, u16 lineCycle) -> u32 { return (line + 1) * 341 + lineCycle - ((line >= 0 && (frame % 2)) ? 1 : 0); };
+    u32 current = position(scanline, cycle);
+    u32 vblank = position(241, 1);
+    u32 event = current <= vblank ? vblank : position(259, 340);
+    nextSyncClock = clock + (event - current) + 1;
+    // mapper IRQ
+    if(mapper.hasScanlineCounter()) {
+        u32 rises = mapper.scanlineIRQDistance();
+        u16 riseCycle = _a12RiseCycle();
+        if(rises && riseCycle) nextSyncClock = std::min(nextSyncClock, _a12RiseClock(rises, riseCycle) + 1);
     }
 }
 
-// should last roughly PPUCycle nanoseconds
-void PPU::emulateCycle() {
-    step();
+/*
+    PPU A12 rises, when pattern fetches go from $0xxx to $1xxx table. With different tables for background and sprites
+        it happens once per rendered scanline: on sprite fetches(dot 260) or on the next line's background fetches(dot 324).
+    With the same table there are no rises, which could clock the counter(they are filtered by MMC3).
+    8x16 sprites are counted as fetched from $1000.
+    Returns 0, if there are no rises.
+*/
+u16 PPU::_a12RiseCycle() const {
+    if(renderingDisabled()) return 0;
+    bool bckgHigh = ppuRegisters.readPpuctrlBckgPTAddr();
+    bool spritesHigh = ppuRegisters.readPpuctrlSpritePTAddrt() || ppuRegisters.readPpuctrlSpriteSize();
+    if(spritesHigh && !bckgHigh) return 260;
+    if(bckgHigh && !spritesHigh) return 324;
+    return 0;
+}
+
+// PPU clock of the n-th A12 rise from now(rises are on riseCycle of prerender and visible scanlines)
+u64 PPU::_a12RiseClock(u32 rises, u16 riseCycle) const {
+    auto position = [](i16 line, u16 lineCycle, u64 frameNum) -> u32 { return (line + 1) * 341 + lineCycle - ((line >= 0 && (frameNum % 2)) ? 1 : 0); };
+    u64 frameNum = frame;
+    u64 frameStart = clock - position(scanline, cycle, frameNum);
+    i16 line = scanline >= 240 ? 240 : (cycle <= riseCycle ? scanline : scanline + 1);
+    while(true) {
+        u32 available = 240 - line;
+        if(rises <= available) return frameStart + position(line + rises - 1, riseCycle, frameNum);
+        rises -= available;
+        // frame is scanlines -1...259, prerender scanline of odd frame is 1 cycle shorter
+        frameStart += 261 * 341 - (frameNum % 2);
+        ++frameNum;
+        line = -1;
+    }
 }
 
 /*
@@ -189,12 +349,75 @@ Serialization::BytesCount PPU::deserialize(const std::string &buf, Serialization
     auto spd8Wr = wrapArr(spritesPatternDataShifts8);
     auto sadWr  = wrapArr(spriteAttributeBytes);
     auto scWr   = wrapArr(spriteXCounters);
-    return Serialization::Deserializer::deserializeAll(buf, offset, &regs.ppuctrl, &regs.ppumask, &regs.ppustatus, &regs.oamaddr, &regs.oamdata,
+    auto res = Serialization::Deserializer::deserializeAll(buf, offset, &regs.ppuctrl, &regs.ppumask, &regs.ppustatus, &regs.oamaddr, &regs.oamdata,
                                                    &regs.ppuscroll, &regs.ppuaddr, &regs.ppudata, &regs.oamdma, &memWr,
                                                    &v, &t, &x, &w, &pd16Wr, &ad8Wr, &adlWr,
                                                    &ntByte, &attrByte, &lowBgByte, &highBgByte, &oamWr, &soamWr, &mapBWr, &mapSWr, &spd8Wr,
                                                    &sadWr, &scWr, &spriteLowPatternByte, &spriteHighPatternByte,
                                                    &frame, &scanline, &cycle);
+    // loaded state is already synchronized with CPU
+    masterClock = clock;
+    _updateNextSyncClock();
+    return res;
+}
+
+void PPU::saveState(PPUState& state) const {
+    state.registers = ppuRegisters.ppuRegisters;
+    state.v = v; state.t = t; state.x = x; state.w = w;
+    state.patternDataShifts16 = patternDataShifts16;
+    state.attrDataShifts8 = attrDataShifts8;
+    state.attrDataLatches = attrDataLatches;
+    state.ntByte = ntByte; state.attrByte = attrByte; state.lowBgByte = lowBgByte; state.highBgByte = highBgByte;
+    state.OAM = OAM;
+    state.secondaryOAM = secondaryOAM;
+    state.bckgMap = ppuMap.bckgMap;
+    state.spriteMap = ppuMap.spriteMap;
+    state.lineBckg = lineBckg;
+    state.lineSprites = lineSprites;
+    state.lineSpritesMask = lineSpritesMask;
+    state.spritesPatternDataShifts8 = spritesPatternDataShifts8;
+    state.spriteAttributeBytes = spriteAttributeBytes;
+    state.spriteXCounters = spriteXCounters;
+    state.spriteLowPatternByte = spriteLowPatternByte;
+    state.spriteHighPatternByte = spriteHighPatternByte;
+    state.lowBgByteAddr = lowBgByteAddr; state.spritePatternAddr = spritePatternAddr;
+    state.readBuffer = readBuffer;
+    state.spriteEvalM = spriteEvalM; state.spriteEvalN = spriteEvalN; state.spriteEvalSlot = spriteEvalSlot;
+    state.frame = frame; state.scanline = scanline; state.cycle = cycle;
+    state.renderFrame = renderFrame; state.renderNextFrame = renderNextFrame;
+    state.clock = clock;
+    state.memory = memory.getMemory();
+}
+
+void PPU::loadState(const PPUState& state) {
+    ppuRegisters.ppuRegisters = state.registers;
+    v = state.v; t = state.t; x = state.x; w = state.w;
+    patternDataShifts16 = state.patternDataShifts16;
+    attrDataShifts8 = state.attrDataShifts8;
+    attrDataLatches = state.attrDataLatches;
+    ntByte = state.ntByte; attrByte = state.attrByte; lowBgByte = state.lowBgByte; highBgByte = state.highBgByte;
+    OAM = state.OAM;
+    secondaryOAM = state.secondaryOAM;
+    ppuMap.bckgMap = state.bckgMap;
+    ppuMap.spriteMap = state.spriteMap;
+    lineBckg = state.lineBckg;
+    lineSprites = state.lineSprites;
+    lineSpritesMask = state.lineSpritesMask;
+    spritesPatternDataShifts8 = state.spritesPatternDataShifts8;
+    spriteAttributeBytes = state.spriteAttributeBytes;
+    spriteXCounters = state.spriteXCounters;
+    spriteLowPatternByte = state.spriteLowPatternByte;
+    spriteHighPatternByte = state.spriteHighPatternByte;
+    lowBgByteAddr = state.lowBgByteAddr; spritePatternAddr = state.spritePatternAddr;
+    readBuffer = state.readBuffer;
+    spriteEvalM = state.spriteEvalM; spriteEvalN = state.spriteEvalN; spriteEvalSlot = state.spriteEvalSlot;
+    frame = state.frame; scanline = state.scanline; cycle = state.cycle;
+    renderFrame = state.renderFrame; renderNextFrame = state.renderNextFrame;
+    clock = state.clock;
+    memory.getMemory() = state.memory;
+    // snapshot is taken from caught up PPU
+    masterClock = clock;
+    _updateNextSyncClock();
 }
 
 void PPU::preRender() {
@@ -247,7 +470,7 @@ void PPU::visibleRender() {
     }
     // ppu begins to render pixels at tick=3(cycle=2)
     if(cycle >= 2 && cycle <= 257) {
-        drawBackgroundPixel(cycle - 2, scanline);
+        drawBackgroundPixel(cycle - 2, ppuRegisters.ppuRegisters.ppumask);
         _renderInternalBckgShifts();
     }
     if(cycle > 329 && cycle <= 337) _renderInternalBckgShifts();
@@ -264,12 +487,14 @@ void PPU::postRender() {
 // just turning on vblank on cycle number 1(SECOND cycle)
 void PPU::verticalBlank() {
     if (scanline == 241 && cycle == 1) {
-        frameQueue.pushActiveFrameToQueue();
-        frameQueue.incrementActiveFrame();
+        // skipped frame is not shown
+        if(renderFrame) {
+            frameQueue.publishActiveFrame();
+            notify((int)PPUEvent::RerenderMe);
+        }
         ppuRegisters.writePpustatusVblank(1);
-        notify((int)PPUEvent::RerenderMe);
         // nmi request will be send after step is complete
-        if(ppuRegisters.readPpuctrlVblankNMI()) eventQueue.get().push(EventType::InterruptNMI);
+        if(ppuRegisters.readPpuctrlVblankNMI()) eventQueue.post(EventType::InterruptNMI, clock);
     }
 }
 
@@ -282,49 +507,49 @@ void PPU::pixelRender() {
     case 257 ... 320: _spriteEvaluateFetchData(); ppuRegisters.writeOamaddr(0); break;
     }
     // it should be called AFTER 257 cycle background pixel rendering. There is exactly 8 cycles to draw sprite line before it's registers will be cleared.
-    if(cycle >= 257 && cycle <= 320) drawSpritePixel(scanline);
+    // Nothing is drawn on prerender scanline.
+    if(scanline >= 0 && cycle >= 258 && cycle <= 320) drawSpritePixel();
+    if(scanline >= 0 && cycle == 320) _composeScanline();
     if((cycle >= 265 && cycle <= 321) && (((cycle - 1) % 8) == 0)) _spriteEvaluateFedData();
 }
 
-void PPU::drawBackgroundPixel(u8 xCoord, u8 yCoord) {
-    const auto& ppuMem = memory.getMemory();
-    // get background pixel
-    // keeping in mind fine x scroll
-    u16 shiftMask16 = 0b1000000000000000 >> x;
-    u8  shiftMask8  = 0b10000000 >> x;
-    // OPTIMIZATION: memory access operation with all its check may by expensive, so, as we access only palette here, we can read memory directly
-    u32 bckgColor = Palette[ppuMem[0x3f00]];
+/*
+    ppumask is passed by caller, so _renderScanline() reads it once per scanline.
+    For frames, which are not rendered, only transparency map is updated(sprite 0 hit needs it), colors aren't looked up.
+*/
+void PPU::drawBackgroundPixel(u8 xCoord, u8 ppumask) {
     bool bckgTransparent = true;
     // if show background/leftmost 8 background
-    if((ppuRegisters.ppuRegisters.ppumask & 0b1000) && !(xCoord < 8 && !(ppuRegisters.ppuRegisters.ppumask & 0b10))) {
+    if((ppumask & 0b1000) && !(xCoord < 8 && !(ppumask & 0b10))) {
+        // get background pixel
+        // keeping in mind fine x scroll
+        u16 shiftMask16 = 0b1000000000000000 >> x;
+        u8  shiftMask8  = 0b10000000 >> x;
         u8 bckgPaletteInnerIndex = (patternDataShifts16[0] & shiftMask16 ? 2 : 0) + ((patternDataShifts16[1] & shiftMask16) ? 1 : 0);
-        u8 bckgPaletteNumber = (attrDataShifts8[0] & shiftMask8 ? 2 : 0) + (attrDataShifts8[1] & shiftMask8 ? 1 : 0);
         // if bckgPaletteInnerIndex is 0, we should use the backdrop color
-        if(bckgPaletteInnerIndex != 0) {
-            Address bckgPaletteAddress = 0x3F00 + (bckgPaletteNumber << 2) + bckgPaletteInnerIndex;
-            bckgColor = Palette[ppuMem[bckgPaletteAddress]];
-            bckgTransparent = !(bckgPaletteAddress & 0b11);
+        bckgTransparent = bckgPaletteInnerIndex == 0;
+        if(renderFrame) {
+            // OPTIMIZATION: memory access operation with all its check may by expensive, so, as we access only palette here, we can read memory directly
+            const auto& ppuMem = memory.getMemory();
+            u8 bckgColor = ppuMem[0x3f00];
+            if(!bckgTransparent) {
+                u8 bckgPaletteNumber = (attrDataShifts8[0] & shiftMask8 ? 2 : 0) + (attrDataShifts8[1] & shiftMask8 ? 1 : 0);
+                bckgColor = ppuMem[0x3F00 + (bckgPaletteNumber << 2) + bckgPaletteInnerIndex];
+            }
+            lineBckg[xCoord] = bckgColor;
         }
-        image()[(yCoord << 8) + xCoord] = bckgColor;
     }
-    else {
-        image()[(yCoord << 8) + xCoord] = getForcedBlankColor();
+    else if(renderFrame) {
+        lineBckg[xCoord] = getForcedBlankColor();
     }
     // clearing map here - true means transparent
     ppuMap.setSprite(xCoord, true);
     ppuMap.setBckg(xCoord, bckgTransparent);
-
-    // drawing grid for debug
-#ifdef DEBUG
-    if(drawDebugGrid && (xCoord % 8 == 0 || yCoord % 8 == 0)) {
-        image()[yCoord * 256 + xCoord] = 0xffffff;
-        return;
-    }
-#endif
+    if(renderFrame) lineSpritesMask[xCoord] = 0;
 }
 
 // should be called AFTER all background pixels are drawn
-void PPU::drawSpritePixel(u8 yCoord) {
+void PPU::drawSpritePixel() {
     const auto& ppuMem = memory.getMemory();
     u8 spriteToDraw = (cycle - 258) >> 3;
     u8 i = spriteToDraw;
@@ -334,30 +559,21 @@ void PPU::drawSpritePixel(u8 yCoord) {
     if(spriteXCoord >= 256) return;
     // if not show sprites - return
     if (!(ppuRegisters.ppuRegisters.ppumask & 0b10000 || (spriteXCoord < 8 && ppuRegisters.ppuRegisters.ppumask & 0b100))) {
-        image()[yCoord * 256 + spriteXCoord] = getForcedBlankColor();
+        if(renderFrame) _setSpritePixel(spriteXCoord, getForcedBlankColor());
         return;
     }
 
     bool bckgTransparent = ppuMap.testBckg(spriteXCoord);
     u8 spritePaletteInnerIndex = (spritesPatternDataShifts8[i * 2] & 0b10000000 ? 2 : 0) + (spritesPatternDataShifts8[i * 2 + 1] & 0b10000000 ? 1 : 0);
     u8 spritePaletteNumber = spriteAttributeBytes[i] & 0b11;
-    Address spritePaletteAddress;
-    bool spriteTransparent;
-    if(spritePaletteInnerIndex != 0) {
-        spritePaletteAddress = 0x3F10 + (spritePaletteNumber << 2) + spritePaletteInnerIndex;
-        spriteTransparent = !(spritePaletteAddress & 0b11);
-    }
-    // using backdrop
-    else {
-        spritePaletteAddress = 0x3F00;
-        spriteTransparent = true;
-    }
-    u32 spriteColor = Palette[ppuMem[spritePaletteAddress]];
+    bool spriteTransparent = spritePaletteInnerIndex == 0;
     u8 spritePriority = (spriteAttributeBytes[i] & 0b00100000) >> 5;
 
     // if not have any or have a transparent sprite here - override
-    if(ppuMap.testSprite(spriteXCoord) && spriteXCoord != 255) {
-        image()[yCoord * 256 + spriteXCoord] = colorMultiplexer(bckgTransparent, image()[(yCoord << 8) + spriteXCoord], spriteTransparent, spriteColor, spritePriority);
+    // sprite pixel is drawn if it is not transparent and is in front of background(0 priority) or background is transparent
+    // only for frames, which are rendered: priority between sprites is kept in the map anyway
+    if(renderFrame && ppuMap.testSprite(spriteXCoord) && spriteXCoord != 255 && !spriteTransparent && (bckgTransparent || spritePriority == 0)) {
+        _setSpritePixel(spriteXCoord, ppuMem[0x3F10 + (spritePaletteNumber << 2) + spritePaletteInnerIndex]);
     }
 
     ppuMap.setSprite(spriteXCoord, spriteTransparent);
@@ -370,13 +586,22 @@ void PPU::drawSpritePixel(u8 yCoord) {
     }
 }
 
-u32 PPU::colorMultiplexer(bool bckgTransparent, u32 bckgColor, bool spriteTransparent, u32 spriteColor, u8 spritePriority) {
-    if(bckgTransparent && spriteTransparent) return bckgColor;
-    if(bckgTransparent && !spriteTransparent) return spriteColor;
-    if(!bckgTransparent && spriteTransparent) return bckgColor;
-    // !bckgTransparent && !spriteTransparent
-    if(spritePriority == 0) return spriteColor; // 0 means in front of background
-    else return bckgColor;
+// converting drawn scanline to RGB
+void PPU::_composeScanline() {
+    if(!renderFrame) return;
+    u16* row = &image()[scanline << 8];
+    // greyscale uses only the first column of the palette, emphasis bits are stored above the index
+    const u8 ppumask = ppuRegisters.ppuRegisters.ppumask;
+    u8 colorMask = (ppumask & 0b1) ? 0x30 : 0x3F;
+    Compositor::compose(lineBckg.data(), lineSprites.data(), lineSpritesMask.data(), colorMask, (ppumask >> 5) << 6, row);
+    // drawing grid for debug
+#ifdef DEBUG
+    if(drawDebugGrid) {
+        for(int xCoord = 0; xCoord < 256; ++xCoord) {
+            if(xCoord % 8 == 0 || scanline % 8 == 0) row[xCoord] = 0x20;     // white
+        }
+    }
+#endif
 }
 
 /*
@@ -384,10 +609,10 @@ u32 PPU::colorMultiplexer(bool bckgTransparent, u32 bckgColor, bool spriteTransp
     Usually, it is the color at 0x3F00, BUT if v points to an address in the palette(0x3F00 - 0x3FFF) we should use this value.
     This is so called "background palette hack".
 */
-u32 PPU::getForcedBlankColor() const {
+u8 PPU::getForcedBlankColor() const {
     Address addr = v & AccessAddressMask;
-    if (addr >= 0x3F00 && addr <= 0x3FFF) return Palette[memory.read(addr)];
-    else return Palette[memory.read(0x3F00)];
+    if (addr >= 0x3F00 && addr <= 0x3FFF) return memory.read(addr);
+    else return memory.read(0x3F00);
 }
 
 Address PPU::_getTileAddress() {
@@ -475,15 +700,13 @@ void PPU::_restoreYScrollFromT() {
     Should be called in some render cycles. Fetches different bytes depending on cycle.
 */
 void PPU::_renderInternalFetchByte() {
-    // why read twice if we can read once?
-    static Address lowBgByteAddr = 0;
     u8 remainder = (cycle - 1) & 7;
     switch(remainder) {
      // as byte fetching from memory requires 2 ppu cycles, we will get result on next cycle
     case 0: case 2: case 4: case 6: return;
-    case 1: ntByte =  memory.readDirectly(_getTileAddress()); break;
+    case 1: ntByte =  memory.readNametable(_getTileAddress()); break;
     case 3: {
-        u8 tempAttrByte = memory.readDirectly(_getAttributeAddress());
+        u8 tempAttrByte = memory.readNametable(_getAttributeAddress());
         u8 tileY = (v & 0b1111100000) >> 5;
         u8 tileX = (v & 0b0000011111);
 
@@ -540,43 +763,105 @@ void PPU::_spriteEvaluateClearSecondaryOAM() {
     }
 }
 
-// filling secondary OAM for NEXT scanline
+// filling secondary OAM for NEXT scanline dot by dot. It is used, when CPU can access OAM or OAMADDR in the middle of the scanline
 void PPU::_spriteEvaluate() {
     // sprite evaluation not occures if rendering is disabled
     if(renderingDisabled()) return;
-    // OAM[n*4 + m] - access to OAM sprite
-    static u8 m = 0;
-    static u16 n = 0;
-    // current slot in secondary OAM
-    static u8 secondarySlot = 0;
     // initializing on cycle 65. First sprite is the one at oamaddr
     if (cycle == 65) {
-        m = ppuRegisters.readOamaddr() % 4;
-        n = ppuRegisters.readOamaddr() / 4;
-        secondarySlot = 0;
+        spriteEvalM = ppuRegisters.readOamaddr() % 4;
+        spriteEvalN = ppuRegisters.readOamaddr() / 4;
+        spriteEvalSlot = 0;
     }
     // even cycles - writing to secondary OAM
     if (!(cycle % 2)) {
         // if oamaddr at start of dot 65 is not 0, overflow can occure. In this case, just ignoring next values
-        if (n >= 64) return;
-        u8 tempY = OAM[n * 4];
-        secondaryOAM[secondarySlot * 4] = tempY;
+        if (spriteEvalN >= 64) return;
+        u8 tempY = OAM[spriteEvalN * 4];
         // sprite is on the next scanline
         u8 spriteHeight = ppuRegisters.readPpuctrlSpriteSize() ? 16 : 8;
-        if((secondarySlot < 8) && tempY <= (scanline + 1) && (scanline + 1) < (tempY + spriteHeight)) {
-            secondaryOAM[secondarySlot * 4 + m] = OAM[n * 4 + m];
-            // all slots are already filled - setting sprite overflow
-            if (secondarySlot == 8) ppuRegisters.writePpustatusSpriteOverflow(1);
-            ++m;
-            if(m == 4) { ++secondarySlot; m = 0; ++n; }
+        bool inRange = tempY <= (scanline + 1) && (scanline + 1) < (tempY + spriteHeight);
+        // when secondary OAM is full, it is only read: the next sprite on the scanline sets overflow
+        if(spriteEvalSlot == 8) {
+            if(inRange) ppuRegisters.writePpustatusSpriteOverflow(1);
+            spriteEvalM = 0;
+            ++spriteEvalN;
+            return;
         }
-        else { m = 0; ++n; }
+        secondaryOAM[spriteEvalSlot * 4] = tempY;
+        if(inRange) {
+            secondaryOAM[spriteEvalSlot * 4 + spriteEvalM] = OAM[spriteEvalN * 4 + spriteEvalM];
+            ++spriteEvalM;
+            if(spriteEvalM == 4) { ++spriteEvalSlot; spriteEvalM = 0; ++spriteEvalN; }
+        }
+        else { spriteEvalM = 0; ++spriteEvalN; }
+    }
+}
+
+// bit n is set if sprite n is on the scanline 'line'
+u64 PPU::_spritesOnLine(i16 line, u8 spriteHeight) const {
+    u64 res = 0;
+#if defined(__SSE2__)
+    // Y is in range, if Y <= line and line - Y < spriteHeight. 16 bytes of OAM(4 sprites) are tested at once, only Y bytes are used
+    const __m128i lineVec = _mm_set1_epi8(static_cast<char>(line));
+    const __m128i maxDiff = _mm_set1_epi8(spriteHeight - 1);
+    for(int i = 0; i < 16; ++i) {
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(OAM.data() + i * 16));
+        __m128i above = _mm_cmpeq_epi8(_mm_min_epu8(y, lineVec), y);
+        __m128i diff = _mm_subs_epu8(lineVec, y);
+        __m128i near = _mm_cmpeq_epi8(_mm_min_epu8(diff, maxDiff), diff);
+        u32 bits = _mm_movemask_epi8(_mm_and_si128(above, near));
+        res |= (u64)((bits & 1) | ((bits >> 3) & 2) | ((bits >> 6) & 4) | ((bits >> 9) & 8)) << (i * 4);
+    }
+#else
+    for(int n = 0; n < 64; ++n) {
+        u8 y = OAM[n * 4];
+        if(y <= line && line < y + spriteHeight) res |= (u64)1 << n;
+    }
+#endif
+    return res;
+}
+
+/*
+    Sprite evaluation for the whole scanline at once(dots 65-256), when nothing can change OAM, OAMADDR or PPUCTRL in the middle of it.
+    Sprites on the next scanline are found at once, then they are copied to secondary OAM as dot by dot evaluation does:
+    each found sprite takes 4 even dots(less, if OAMADDR isn't aligned), each skipped - one.
+    When secondary OAM is full, each of the remaining even dots checks one sprite, and overflow is set if any of them is on the scanline.
+*/
+void PPU::_spriteEvaluateScanline() {
+    if(renderingDisabled()) return;
+    u64 onLine = _spritesOnLine(scanline + 1, ppuRegisters.readPpuctrlSpriteSize() ? 16 : 8);
+    spriteEvalM = ppuRegisters.readOamaddr() % 4;
+    spriteEvalN = ppuRegisters.readOamaddr() / 4;
+    spriteEvalSlot = 0;
+    // even dots 66-256
+    u16 dots = 96;
+    while(dots && spriteEvalN < 64 && spriteEvalSlot < 8) {
+        secondaryOAM[spriteEvalSlot * 4] = OAM[spriteEvalN * 4];
+        if(onLine & ((u64)1 << spriteEvalN)) {
+            while(dots && spriteEvalM < 4) {
+                secondaryOAM[spriteEvalSlot * 4 + spriteEvalM] = OAM[spriteEvalN * 4 + spriteEvalM];
+                ++spriteEvalM;
+                --dots;
+            }
+            if(spriteEvalM < 4) break;
+            ++spriteEvalSlot;
+        }
+        else --dots;
+        spriteEvalM = 0;
+        ++spriteEvalN;
+    }
+    // the rest of sprites is only read
+    if(spriteEvalSlot == 8) {
+        u16 checked = std::min<u16>(dots, 64 - spriteEvalN);
+        if(checked && ((onLine >> spriteEvalN) & (~(u64)0 >> (64 - checked)))) ppuRegisters.writePpustatusSpriteOverflow(1);
+        spriteEvalN += checked;
+        spriteEvalM = 0;
     }
 }
 
 // fetching data and writing it to the temporary registers
 void PPU::_spriteEvaluateFetchData() {
-    static Address pbAddr = 0;
     u8 remainder = (cycle - 1) & 7;
     u8 spriteIndex = (cycle - 257) >> 3;
     switch(remainder) {
@@ -585,17 +870,18 @@ void PPU::_spriteEvaluateFetchData() {
     // garbage reads NOT NEEDED
     case 1: break;
     case 3: break;
+    // flipped sprites get already reversed bytes from CHR cache
     case 5: {
         if(secondaryOAM[spriteIndex * 4] >= 240) spriteLowPatternByte = 0;
         else {
-            pbAddr = _getPatternLowerOAM(secondaryOAM[spriteIndex * 4 + 1]);
-            spriteLowPatternByte = memory.read(pbAddr);
+            spritePatternAddr = _getPatternLowerOAM(secondaryOAM[spriteIndex * 4 + 1]);
+            spriteLowPatternByte = (secondaryOAM[spriteIndex * 4 + 2] & 0b01000000) ? memory.readCHRFlipped(spritePatternAddr) : memory.readCHR(spritePatternAddr);
         }
         break;
     }
     case 7: {
         if(secondaryOAM[spriteIndex * 4] >= 240) spriteHighPatternByte = 0;
-        else spriteHighPatternByte = memory.read(pbAddr + 8);
+        else spriteHighPatternByte = (secondaryOAM[spriteIndex * 4 + 2] & 0b01000000) ? memory.readCHRFlipped(spritePatternAddr + 8) : memory.readCHR(spritePatternAddr + 8);
         break;
     }
     }
@@ -604,9 +890,9 @@ void PPU::_spriteEvaluateFetchData() {
 // filling sprite shift registers, latches and counters
 void PPU::_spriteEvaluateFedData() {
     u8 spriteIndex = (cycle - 265) / 8;
-    u8 flipHorizontal = secondaryOAM[spriteIndex * 4 + 2] & 0b01000000;
-    spritesPatternDataShifts8[spriteIndex * 2] = flipHorizontal ? reverseByte(spriteHighPatternByte) : spriteHighPatternByte;
-    spritesPatternDataShifts8[spriteIndex * 2 + 1] = flipHorizontal ? reverseByte(spriteLowPatternByte) : spriteLowPatternByte;
+    // pattern bytes are already flipped on fetching
+    spritesPatternDataShifts8[spriteIndex * 2] = spriteHighPatternByte;
+    spritesPatternDataShifts8[spriteIndex * 2 + 1] = spriteLowPatternByte;
     spriteAttributeBytes[spriteIndex] = secondaryOAM[spriteIndex * 4 + 2];
     spriteXCounters[spriteIndex] = secondaryOAM[spriteIndex * 4 + 3];
 }
@@ -1,17 +1,20 @@
 #include "include/ppumemory.hpp"
 
 PPUMemory::PPUMemory(MapperInterface &_mapper, Logger* _logger)
-    : memory{}, mapper{_mapper}, logger{_logger} {}
+    : memory{}, nametablePages{}, mapper{_mapper}, chrCache{_mapper}, logger{_logger} {
+    _mapNametables();
+    mapper.attach(this);
+}
 
-u8 PPUMemory::read(Address address) {
-    auto optionalRes = mapper.readCHR(address);
-    if (optionalRes) return optionalRes.value();
-    address = _fixAddress(address);
-    return memory[address];
+PPUMemory::~PPUMemory() {
+    mapper.detach(this);
 }
 
-u8 PPUMemory::readCHR(Address address) {
-    return mapper.readCHR(address).value();
+// mapper is only asked for pattern tables, nametables are looked up in the page table directly
+u8 PPUMemory::read(Address address) {
+    if (address < 0x2000) return readCHR(address);
+    if (address < 0x3F00) return readNametable(address);
+    return memory[_fixAddress(address)];
 }
 
 u8 PPUMemory::readDirectly(Address address) {
@@ -23,29 +26,36 @@ u8 PPUMemory::readDirectlyWithoutChecks(Address address) {
 }
 
 PPUMemory& PPUMemory::write(Address address, u8 val) {
-    auto optionalRes = mapper.writeCHR(address, val);
-    if (optionalRes) return *this;
-    address = _fixAddress(address);
-    memory[address] = val;
+    if (address < 0x2000) {
+        mapper.writeCHR(address, val);
+        chrCache.refresh(address);
+    }
+    else if (address < 0x3F00) memory[nametablePages[(address >> 10) & 0b11] | (address & 0x3FF)] = val;
+    else memory[_fixAddress(address)] = val;
     return *this;
 }
 
 Address PPUMemory::_fixAddress(Address address) {
-    if(address >= 0x2000 && address < 0x3000) return _applyMirroring(address);
-    if(address >= 0x3000 && address < 0x3F00) return _applyMirroring(address - 0x1000);      // mirroring nametables, also don't forget to mirror mirrored data :)
+    // nametables, $3000-$3EFF mirrors $2000-$2EFF
+    if(address >= 0x2000 && address < 0x3F00) return nametablePages[(address >> 10) & 0b11] | (address & 0x3FF);
     if(address >= 0x3F20 && address < 0x4000) return 0x3F00 + (address % 0x20); // mirroring pallette indexes
     if(address == 0x3F10 || address == 0x3F14 || address == 0x3F18 || address == 0x3F1C) return address - 0x0010;  // also palette mirroring
     return address;
 }
 
-Address PPUMemory::_applyMirroring(Address address) {
+void PPUMemory::update(MapperInterface*, int eventType) {
+    if(eventType == (int)MapperEvent::MirroringChanged) _mapNametables();
+}
+
+// VRAM pages are stored at $2000-$2FFF of memory, mirrored nametables share one of them(four-screen mirroring would use all 4)
+void PPUMemory::_mapNametables() {
     switch (mapper.mirroring()) {
-    case Mirroring::Horizontal: if (address & 0x400) return address - 0x400; else return address;
-    case Mirroring::Vertical: if(address & 0x800) return address - 0x800; else return address;
-    case Mirroring::OneScreenLower: case Mirroring::OneScreenUpper: return 0x2000 + (address % 0x400);
+    case Mirroring::Horizontal: nametablePages = {0x2000, 0x2000, 0x2800, 0x2800}; break;
+    case Mirroring::Vertical: nametablePages = {0x2000, 0x2400, 0x2000, 0x2400}; break;
+    case Mirroring::OneScreenLower: case Mirroring::OneScreenUpper: nametablePages = {0x2000, 0x2000, 0x2000, 0x2000}; break;
 #ifdef DEBUG
     default:
-        if (logger) { logger->log(LogLevel::Error, "PPUMemory::_applyMirroring() - unknown mirroring type");  throw UnknownMirroringType{}; };
+        if (logger) { logger->log(LogLevel::Error, "PPUMemory::_mapNametables() - unknown mirroring type");  throw UnknownMirroringType{}; };
 #else
     default: throw UnknownMirroringType{};
 #endif
@@ -0,0 +1,166 @@
+#include "include/rewind.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+    // snapshot has u64 fields, so it is aligned and padded to whole words
+    static_assert(sizeof(Snapshot) % sizeof(u64) == 0, "Snapshot is encoded by 8-byte words");
+    const std::size_t SnapshotWords = sizeof(Snapshot) / sizeof(u64);
+    // every run header covers at least one word
+    const std::size_t MaxEncodedSize = sizeof(Snapshot) + 4 * (SnapshotWords + 1);
+    const u16 MaxRun = 0xFFFF;
+
+    inline u64 loadWord(const u8* ptr, std::size_t word) {
+        u64 res;
+        std::memcpy(&res, ptr + word * sizeof(u64), sizeof(u64));
+        return res;
+    }
+}
+
+RewindBuffer::RewindBuffer(std::size_t memoryLimit, u32 _keyframeInterval)
+    : ring(memoryLimit), entries{}, head{0}, usedBytes{0}, keyframeInterval{std::max<u32>(_keyframeInterval, 1)}, current{}, reference{},
+      referenceFrame{0}, referenceValid{false}, encoded(MaxEncodedSize), pushTime{0}, pushes{0} {}
+
+void RewindBuffer::push() {
+    auto start = std::chrono::steady_clock::now();
+    u64 frame = current.ppu.frame;
+    _dropFrom(frame);
+    std::size_t deltas = 0;
+    for(auto it = entries.rbegin(); it != entries.rend() && !it->keyframe; ++it) ++deltas;
+    bool keyframe = entries.empty() || deltas + 1 >= keyframeInterval;
+    if(!keyframe) _loadReference(entries.size() - 1);
+    std::size_t size = _encode(reinterpret_cast<const u8*>(&current), keyframe ? nullptr : reinterpret_cast<const u8*>(&reference), encoded.data());
+    _store(size, keyframe);
+    if(keyframe && !entries.empty()) {
+        reference = current;
+        referenceFrame = frame;
+        referenceValid = true;
+    }
+    pushTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    ++pushes;
+}
+
+const Snapshot* RewindBuffer::restore(u64 frame) {
+    if(entries.empty()) return nullptr;
+    std::size_t index = entries.size() - 1;
+    while(index > 0 && entries[index].frame > frame) --index;
+    _dropFrom(entries[index].frame + 1);
+    _loadReference(index);
+    const Entry& entry = entries[index];
+    if(entry.keyframe) current = reference;
+    else _decode(&ring[entry.offset], entry.size, reinterpret_cast<const u8*>(&reference), reinterpret_cast<u8*>(&current));
+    return &current;
+}
+
+void RewindBuffer::clear() {
+    entries.clear();
+    head = 0;
+    usedBytes = 0;
+    referenceValid = false;
+}
+
+std::size_t RewindBuffer::bytesPerMinute() const {
+    if(entries.size() < 2) return 0;
+    return usedBytes * 3600 / (entries.back().frame - entries.front().frame);
+}
+
+std::size_t RewindBuffer::_encode(const u8* data, const u8* reference, u8* out) {
+    u8* begin = out;
+    std::size_t word = 0;
+    while(word < SnapshotWords) {
+        u16 zeros = 0;
+        while(word < SnapshotWords && zeros < MaxRun && loadWord(data, word) == (reference ? loadWord(reference, word) : 0)) {
+            ++zeros;
+            ++word;
+        }
+        std::size_t literalsStart = word;
+        u16 literals = 0;
+        while(word < SnapshotWords && literals < MaxRun && loadWord(data, word) != (reference ? loadWord(reference, word) : 0)) {
+            ++literals;
+            ++word;
+        }
+        std::memcpy(out, &zeros, sizeof(u16));
+        std::memcpy(out + sizeof(u16), &literals, sizeof(u16));
+        out += 2 * sizeof(u16);
+        for(std::size_t i = literalsStart; i < word; ++i) {
+            u64 val = loadWord(data, i) ^ (reference ? loadWord(reference, i) : 0);
+            std::memcpy(out, &val, sizeof(u64));
+            out += sizeof(u64);
+        }
+    }
+    return out - begin;
+}
+
+void RewindBuffer::_decode(const u8* in, std::size_t size, const u8* reference, u8* out) {
+    const u8* end = in + size;
+    std::size_t word = 0;
+    while(in < end) {
+        u16 zeros, literals;
+        std::memcpy(&zeros, in, sizeof(u16));
+        std::memcpy(&literals, in + sizeof(u16), sizeof(u16));
+        in += 2 * sizeof(u16);
+        if(reference) std::memcpy(out + word * sizeof(u64), reference + word * sizeof(u64), zeros * sizeof(u64));
+        else std::memset(out + word * sizeof(u64), 0, zeros * sizeof(u64));
+        word += zeros;
+        for(u16 i = 0; i < literals; ++i, ++word, in += sizeof(u64)) {
+            u64 val = loadWord(in, 0) ^ (reference ? loadWord(reference, word) : 0);
+            std::memcpy(out + word * sizeof(u64), &val, sizeof(u64));
+        }
+    }
+}
+
+void RewindBuffer::_dropFrom(u64 frame) {
+    while(!entries.empty() && entries.back().frame >= frame) {
+        const Entry& entry = entries.back();
+        if(entry.keyframe && entry.frame == referenceFrame) referenceValid = false;
+        usedBytes -= entry.size;
+        entries.pop_back();
+    }
+    head = entries.empty() ? 0 : entries.back().offset + entries.back().size;
+}
+
+// deltas without their keyframe are useless, so they are dropped too
+void RewindBuffer::_dropOldest() {
+    do {
+        const Entry& entry = entries.front();
+        if(entry.keyframe && entry.frame == referenceFrame) referenceValid = false;
+        usedBytes -= entry.size;
+        entries.pop_front();
+    } while(!entries.empty() && !entries.front().keyframe);
+}
+
+void RewindBuffer::_store(std::size_t size, bool keyframe) {
+    // snapshot doesn't fit into the whole ring
+    if(size > ring.size()) {
+        clear();
+        return;
+    }
+    std::size_t end = head;
+    std::size_t pos = end;
+    if(pos + size > ring.size()) {
+        // tail of the ring is left unused, entries there are the oldest ones
+        while(!entries.empty() && entries.front().offset >= end) _dropOldest();
+        pos = 0;
+    }
+    while(!entries.empty() && entries.front().offset >= pos && entries.front().offset < pos + size) _dropOldest();
+    // delta has lost its keyframe
+    if(!keyframe && entries.empty()) {
+        clear();
+        return;
+    }
+    std::copy(encoded.begin(), encoded.begin() + size, ring.begin() + pos);
+    entries.push_back(Entry{current.ppu.frame, pos, size, keyframe});
+    head = pos + size;
+    usedBytes += size;
+}
+
+void RewindBuffer::_loadReference(std::size_t index) {
+    while(!entries[index].keyframe) --index;
+    const Entry& entry = entries[index];
+    if(!referenceValid || referenceFrame != entry.frame) {
+        _decode(&ring[entry.offset], entry.size, nullptr, reinterpret_cast<u8*>(&reference));
+        referenceFrame = entry.frame;
+        referenceValid = true;
+    }
+}
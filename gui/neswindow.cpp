@@ -13,23 +13,35 @@ NESWindow::NESWindow(Logger* logger, QWidget *parent) :
     createMenuActions();
     createMenu();
 
+    latencyTimer = new QTimer(this);
+    connect(latencyTimer, SIGNAL(timeout()), this, SLOT(showLatency()));
+    latencyTimer->start(1000);
 }
 
 NESWindow::~NESWindow() {
     stopCpu();
+    renderer.reset();
+}
+
+void NESWindow::startRenderer() {
+    renderer = std::move(Uptr<RenderThread>(new RenderThread(reinterpret_cast<void*>(renderWidget->winId()))));
+    if(nes) renderer->setSource(&nes->getPpu());
 }
 
 void NESWindow::loadRom(const std::string& romName) {
     stopCpu();
+    if(renderer) renderer->setSource(nullptr);
     if(nes) nes->getPpu().detach(this);
     nes = std::move(Uptr<NES>(new NES(romName, logger)));
     nes->getPpu().attach(this);
+    if(renderer) renderer->setSource(&nes->getPpu());
     startCpu();
 }
 
 void NESWindow::update(PPU*, int eventType) {
+    // called on CPU thread: only wakes up renderer
     if (renderer && (eventType == (int)PPUEvent::RerenderMe)) {
-        QApplication::postEvent(this, new RenderEvent(), Qt::HighEventPriority);
+        renderer->frameReady();
     }
 }
 
@@ -71,15 +83,6 @@ void NESWindow::keyReleaseEvent(QKeyEvent *event) {
     }
 }
 
-bool NESWindow::event(QEvent* event) {
-    switch(event->type()) {
-    // request to SDL to rerender
-    case RenderEvent::Type: if(renderer) renderer->render(nes->getPpu().getRenderFrame()); return true;
-    default: break;
-    }
-    return QWidget::event(event);
-}
-
 void NESWindow::createMenuActions() {
     openAction = new QAction("&Open", this);
     openAction->setShortcuts(QKeySequence::New);
@@ -118,7 +121,7 @@ void NESWindow::createMenu() {
 
 void NESWindow::cpuWork() {
     while (!cpuStopped) {
-        if (!cpuPaused) nes->doInstruction();
+        if (!cpuPaused) nes->doInstructions();
         else std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 }
@@ -179,4 +182,10 @@ void NESWindow::exit() {
     QApplication::exit();
 }
 
-
+void NESWindow::showLatency() {
+    if(!renderer || !nes) return;
+    u32 latency = renderer->takeAveragePresentLatency();
+    statusBar()->showMessage(QString("Present latency: %1 ms, dropped frames: %2")
+                             .arg(latency / 1000.0, 0, 'f', 1)
+                             .arg(nes->getPpu().getFrameQueue().droppedFrames()));
+}
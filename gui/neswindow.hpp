@@ -2,19 +2,9 @@
 #include <QtCore>
 #include <QtGui>
 #include <QtWidgets>
-#include <mutex>
-#include <condition_variable>
 #include "observer/observer.hpp"
 #include "core/include/ppu.hpp"
-#include "gui/sdlgui.hpp"
-
-class RenderEvent : public QEvent {
-public:
-    static const QEvent::Type Type = static_cast<QEvent::Type>(QEvent::User + 0);
-    RenderEvent() : QEvent(RenderEvent::type()) {}
-    virtual ~RenderEvent() {}
-    inline QEvent::Type type() const { return Type; }
-};
+#include "gui/renderthread.hpp"
 
 class NESWindow : public QMainWindow, public Observer<PPU>
 {
@@ -24,12 +14,12 @@ public:
     ~NESWindow();
 
     inline const QWidget* getRenderWidget () { return renderWidget; }
-    inline NESWindow& setRenderer(GuiSDL* sdlGui) { renderer = sdlGui; return *this; }
+    // starts rendering into render widget(it should be already shown)
+    void startRenderer();
     void loadRom(const std::string& romName);
 
     void keyPressEvent(QKeyEvent *event);
     void keyReleaseEvent(QKeyEvent* event);
-    bool event(QEvent* event);
     void update(PPU*, int);
 private:
     void createMenuActions();
@@ -41,7 +31,9 @@ private:
 
     Uptr<NES> nes;
     QWidget* renderWidget;
-    GuiSDL* renderer;
+    Uptr<RenderThread> renderer;
+    // shows present latency in status bar
+    QTimer* latencyTimer;
     Logger* logger;
     QMenu* mainMenu;
     QAction* openAction;
@@ -62,4 +54,5 @@ private slots:
     void resume();
     void togglePause();
     void exit();
+    void showLatency();
 };
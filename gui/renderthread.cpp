@@ -0,0 +1,64 @@
+#include "gui/renderthread.hpp"
+
+RenderThread::RenderThread(void* wndPtr)
+    : pending{false}, stopped{false}, source{nullptr}, lastLatency{0}, latencySum{0}, latencyCount{0}, presented{0} {
+    thread = std::thread([this, wndPtr]() {
+        work(wndPtr);
+    });
+}
+
+RenderThread::~RenderThread() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    cv.notify_one();
+    if(thread.joinable()) thread.join();
+}
+
+void RenderThread::setSource(PPU* ppu) {
+    std::lock_guard<std::mutex> lock(sourceMutex);
+    source = ppu;
+}
+
+void RenderThread::frameReady() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = true;
+        readyTime = Clock::now();
+    }
+    cv.notify_one();
+}
+
+u32 RenderThread::takeAveragePresentLatency() {
+    u64 sum = latencySum.exchange(0, std::memory_order_relaxed);
+    u32 count = latencyCount.exchange(0, std::memory_order_relaxed);
+    return count ? sum / count : 0;
+}
+
+void RenderThread::work(void* wndPtr) {
+    // SDL renderer should be used only from thread, which created it
+    GuiSDL gui(256, 240, wndPtr);
+    while(true) {
+        Clock::time_point frameTime;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return pending || stopped; });
+            if(stopped) return;
+            pending = false;
+            frameTime = readyTime;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sourceMutex);
+            if(!source) continue;
+            Frame* frame = source->getRenderFrame();
+            if(!frame) continue;
+            gui.render(frame);
+        }
+        u32 latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - frameTime).count();
+        lastLatency.store(latency, std::memory_order_relaxed);
+        latencySum.fetch_add(latency, std::memory_order_relaxed);
+        latencyCount.fetch_add(1, std::memory_order_relaxed);
+        presented.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include "core/include/ppu.hpp"
+#include "gui/sdlgui.hpp"
+
+/*
+    Presents frames on its own thread, so neither Qt event loop(menus, dialogs) nor CPU thread waits for vsync.
+    GuiSDL is created and used only here.
+    CPU thread only marks, that new frame is ready. If several frames come before the renderer wakes up,
+        only the newest is presented(frame queue keeps it).
+*/
+class RenderThread {
+public:
+    // wndPtr - native window to render in
+    RenderThread(void* wndPtr);
+    ~RenderThread();
+    // frames are taken from this PPU(nullptr - nothing to render). Waits for the current frame to be presented
+    void setSource(PPU* ppu);
+    // called by CPU thread after a frame is published. Doesn't wait for rendering
+    void frameReady();
+
+    // time between publishing of a frame and return from its present, in microseconds
+    inline u32 lastPresentLatency() const { return lastLatency.load(std::memory_order_relaxed); }
+    // average latency of frames, presented since the last call
+    u32 takeAveragePresentLatency();
+    inline u64 presentedFrames() const { return presented.load(std::memory_order_relaxed); }
+private:
+    typedef std::chrono::steady_clock Clock;
+    void work(void* wndPtr);
+
+    std::thread thread;
+    // guards 'pending', 'stopped' and 'readyTime'
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool pending;
+    bool stopped;
+    Clock::time_point readyTime;
+    // guards 'source' while frame is rendered
+    std::mutex sourceMutex;
+    PPU* source;
+
+    std::atomic<u32> lastLatency;
+    std::atomic<u64> latencySum;
+    std::atomic<u32> latencyCount;
+    std::atomic<u64> presented;
+};
@@ -6,7 +6,7 @@
     Other parts of GUI are implemented with Qt.
 */
 GuiSDL::GuiSDL(u16 w, u16 h, void* wndPtr)
-    : width{w}, height{h}
+    : width{w}, height{h}, converter{PixelFormat::RGB888}, presentOnlyNewFrames{true}
 {
     SDL_Init(SDL_INIT_VIDEO);
     atexit(SDL_Quit);
@@ -30,9 +30,15 @@ GuiSDL::~GuiSDL() {
 
 void GuiSDL::render(Frame* frame) {
     if(frame) {
-        SDL_UpdateTexture(texture, NULL, frame, width * 4);
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
+        // no intermediate buffer: frame is converted right into the texture
+        void* texPixels;
+        int pitch;
+        if(SDL_LockTexture(texture, NULL, &texPixels, &pitch) != 0) return;
+        converter.convert(*frame, texPixels, pitch);
+        SDL_UnlockTexture(texture);
     }
+    else if(presentOnlyNewFrames) return;
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
 }
 
@@ -3,6 +3,7 @@
 #include <mutex>
 #include <condition_variable>
 #include "nes.hpp"
+#include "core/include/frameconverter.hpp"
 
 typedef int64_t i64;
 
@@ -13,7 +14,10 @@ public:
     // wndPtr is used for initializaing SDL from an existing window
     GuiSDL(u16 w, u16 h, void* wndPtr = nullptr);
     ~GuiSDL();
+    // frame == nullptr means, that there is no new frame
     void render(Frame* frame);
+    // if false, texture with the last frame is presented again, when there is no new frame
+    inline void setPresentOnlyNewFrames(bool val) { presentOnlyNewFrames = val; }
 
 private:
     SDL_Window* window;
@@ -21,4 +25,7 @@ private:
     SDL_Texture* texture;
     u16 width;
     u16 height;
+    // converts frames straight into locked texture memory
+    FrameConverter converter;
+    bool presentOnlyNewFrames;
 };
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+
+#include "nes.hpp"
+#include "core/include/frameconverter.hpp"
+#include "selftest.hpp"
+
+/*
+    Usage: HaniwaNESHeadless <rom> <frames> [--throttle] [--frameskip <n>] [--auto-frameskip] [--dump <file.ppm>] [--rewind <MB>] [--no-jit] [--selftest]
+    Runs the game for the given number of frames without GUI and prints how fast it was.
+    --frameskip draws only one frame out of n + 1, --auto-frameskip draws no more than 60 frames per second.
+    --dump saves the last drawn frame as PPM image.
+    --rewind keeps rewind history of every frame in the given memory and prints how much memory a minute of it takes.
+    --no-jit interprets translated blocks instead of running their native code.
+    --selftest runs self-tests(see selftest.hpp) on the game for the given number of frames instead, exit code is 1 if any has failed.
+*/
+
+void dumpFrame(const Frame& frame, const std::string& fname) {
+    std::ofstream ofs(fname, std::ios_base::binary);
+    FrameConverter converter(PixelFormat::RGB888);
+    ofs << "P6 256 240 255\n";
+    for(u16 framePixel : frame) {
+        u32 pixel = converter.pixel(framePixel);
+        ofs.put((pixel >> 16) & 0xFF).put((pixel >> 8) & 0xFF).put(pixel & 0xFF);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <rom> <frames> [--throttle] [--frameskip <n>] [--auto-frameskip] [--dump <file.ppm>] [--rewind <MB>] [--no-jit] [--selftest]\n";
+        return 1;
+    }
+    std::string romName = argv[1];
+    u64 frames = std::stoull(argv[2]);
+    bool throttle = false;
+    u32 frameskip = 0;
+    bool autoFrameskip = false;
+    std::string dumpName;
+    std::size_t rewindMB = 0;
+    bool jit = true;
+    bool selfTest = false;
+    for(int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--throttle") throttle = true;
+        else if(arg == "--frameskip" && i + 1 < argc) frameskip = std::stoul(argv[++i]);
+        else if(arg == "--auto-frameskip") autoFrameskip = true;
+        else if(arg == "--dump" && i + 1 < argc) dumpName = argv[++i];
+        else if(arg == "--rewind" && i + 1 < argc) rewindMB = std::stoul(argv[++i]);
+        else if(arg == "--no-jit") jit = false;
+        else if(arg == "--selftest") selfTest = true;
+    }
+
+    OstreamLogger logger(std::cerr, 0b1100);
+    if(selfTest) {
+        bool passed = selfTestCompositor(std::cout)
+                   && selfTestRewindBuffer(std::cout)
+                   && selfTestSpriteEvaluation(romName, &logger, std::cout)
+                   && selfTestRewind(romName, frames, &logger, std::cout)
+                   && selfTestJIT(romName, frames, &logger, std::cout);
+        std::cout << (passed ? "self-test passed" : "self-test FAILED") << std::endl;
+        return passed ? 0 : 1;
+    }
+    NES nes(romName, &logger);
+    nes.setThrottling(throttle);
+    nes.setFrameskip(frameskip);
+    nes.setAutoFrameskip(autoFrameskip);
+    nes.getCpu().setJIT(jit);
+    if(rewindMB) nes.enableRewind(rewindMB << 20);
+
+    auto start = std::chrono::steady_clock::now();
+    Frame* lastFrame = nullptr;
+    for(u64 i = 0; i < frames; ++i) {
+        nes.runFrames(1);
+        // nobody renders frames here, so the newest one is taken manually
+        if(Frame* frame = nes.getPpu().getRenderFrame()) lastFrame = frame;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "frames: " << frames << ", instructions: " << nes.getCpu().getInstructionCounter()
+              << ", time: " << elapsed.count() << "s, fps: " << frames / elapsed.count()
+              << ", dropped frames: " << nes.getPpu().getFrameQueue().droppedFrames() << std::endl;
+    if(const RewindBuffer* rewind = nes.getRewindBuffer()) {
+        std::cout << "rewind: " << rewind->snapshotsCount() << " snapshots since frame " << rewind->oldestFrame()
+                  << ", " << rewind->memoryUsage() / 1024 << " KB, " << rewind->bytesPerMinute() / 1024 << " KB per minute, "
+                  << rewind->averagePushTime() << " ns per snapshot(without saving)" << std::endl;
+    }
+    if(!dumpName.empty() && lastFrame) dumpFrame(*lastFrame, dumpName);
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include "selftest.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#include "nes.hpp"
+#include "core/include/compositor.hpp"
+
+namespace {
+    u64 hashBytes(const void* data, std::size_t size, u64 hash = 14695981039346656037ull) {
+        const u8* bytes = static_cast<const u8*>(data);
+        for(std::size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    // frame is hashed only if it was drawn, CPU RAM - always
+    u64 hashFrameAndRAM(NES& nes, const Frame* frame) {
+        u64 hash = hashBytes(nes.getCpu().getMemory().get().data(), 0x800);
+        return frame ? hashBytes(frame->data(), sizeof(Frame), hash) : hash;
+    }
+
+    void randomSnapshot(Snapshot& snapshot, std::mt19937_64& rng) {
+        u8* bytes = reinterpret_cast<u8*>(&snapshot);
+        for(std::size_t i = 0; i < sizeof(Snapshot); ++i) bytes[i] = rng();
+    }
+
+    // changes some bytes like a frame of the game does: a few scattered ones and sometimes a long run
+    void mutateSnapshot(Snapshot& snapshot, std::mt19937_64& rng) {
+        u8* bytes = reinterpret_cast<u8*>(&snapshot);
+        u32 changes = rng() % 64;
+        for(u32 i = 0; i < changes; ++i) bytes[rng() % sizeof(Snapshot)] = rng();
+        if(rng() % 4 == 0) {
+            std::size_t start = rng() % sizeof(Snapshot);
+            std::size_t length = std::min<std::size_t>(rng() % 4096, sizeof(Snapshot) - start);
+            for(std::size_t i = start; i < start + length; ++i) bytes[i] = rng();
+        }
+    }
+
+    /*
+        Pushes 'count' snapshots starting from history[first], then restores them from the newest to the oldest one,
+            which is still in the buffer. Returns false if restored snapshot differs from the pushed one.
+    */
+    bool pushAndRestore(RewindBuffer& buffer, std::vector<Snapshot>& history, u64 first, u64 count, std::mt19937_64& rng, std::ostream& out) {
+        for(u64 frame = first; frame < first + count; ++frame) {
+            if(frame == 0) randomSnapshot(history[frame], rng);
+            else {
+                std::memcpy(&history[frame], &history[frame - 1], sizeof(Snapshot));
+                // same snapshot twice: delta is a single zero run
+                if(frame % 13) mutateSnapshot(history[frame], rng);
+            }
+            history[frame].ppu.frame = frame;
+            // whole bytes are compared, including padding, which isn't guaranteed to be copied by assignment
+            std::memcpy(&buffer.snapshot(), &history[frame], sizeof(Snapshot));
+            buffer.push();
+            if(buffer.memoryUsage() > buffer.capacity()) {
+                out << "rewind buffer uses " << buffer.memoryUsage() << " bytes of " << buffer.capacity() << std::endl;
+                return false;
+            }
+        }
+        if(!buffer.snapshotsCount()) {
+            out << "rewind buffer is empty after " << count << " pushes" << std::endl;
+            return false;
+        }
+        u64 oldest = buffer.oldestFrame();
+        for(u64 frame = first + count; frame-- > oldest;) {
+            const Snapshot* restored = buffer.restore(frame);
+            if(!restored || std::memcmp(restored, &history[frame], sizeof(Snapshot))) {
+                out << "rewind buffer restored wrong snapshot for frame " << frame << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool selfTestCompositor(std::ostream& out) {
+    using namespace Compositor;
+    struct Version {
+        const char* name;
+        ComposeFunction function;
+        bool supported;
+    };
+    std::vector<Version> versions;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    versions.push_back({"SSE2", composeSSE2, static_cast<bool>(__builtin_cpu_supports("sse2"))});
+    versions.push_back({"AVX2", composeAVX2, static_cast<bool>(__builtin_cpu_supports("avx2"))});
+#endif
+    // the one, PPU uses
+    versions.push_back({"compose()", compose, true});
+
+    std::mt19937_64 rng(13);
+    // one byte more, so rows are not aligned
+    std::array<u8, ScanlineWidth + 1> bckg, sprites, spritesMask;
+    std::array<u16, ScanlineWidth + 1> expected, result;
+    // normal and greyscale
+    const u8 colorMasks[] = {0x3F, 0x30};
+    for(int row = 0; row < 1000; ++row) {
+        for(std::size_t i = 0; i <= ScanlineWidth; ++i) {
+            bckg[i] = rng();
+            sprites[i] = rng();
+            // PPU sets mask to 0xFF or 0, long runs of both are frequent
+            spritesMask[i] = (row & 1) ? ((rng() & 1) ? 0xFF : 0) : (((i + row) / 24) & 1) * 0xFF;
+        }
+        u8 colorMask = colorMasks[row & 1];
+        u16 emphasis = (row % 8) << 6;
+        std::size_t offset = (row / 2) & 1;
+        composeScalar(bckg.data() + offset, sprites.data() + offset, spritesMask.data() + offset, colorMask, emphasis, expected.data() + offset);
+        for(const Version& version : versions) {
+            if(!version.supported) continue;
+            result.fill(0);
+            version.function(bckg.data() + offset, sprites.data() + offset, spritesMask.data() + offset, colorMask, emphasis, result.data() + offset);
+            if(!std::equal(expected.begin() + offset, expected.begin() + offset + ScanlineWidth, result.begin() + offset)) {
+                out << "compositor: " << version.name << " differs from scalar version on row " << row << std::endl;
+                return false;
+            }
+        }
+    }
+    out << "compositor:";
+    for(const Version& version : versions) out << " " << version.name << (version.supported ? " OK" : " skipped(not supported)");
+    out << std::endl;
+    return true;
+}
+
+bool selfTestRewindBuffer(std::ostream& out) {
+    std::mt19937_64 rng(25);
+    std::vector<Snapshot> history(400);
+
+    // large ring: nothing is evicted, every keyframe and delta is restored
+    RewindBuffer large(64 << 20, 16);
+    if(!pushAndRestore(large, history, 0, 200, rng, out)) return false;
+    if(large.oldestFrame() != 0) {
+        out << "rewind buffer evicted frames from the large ring" << std::endl;
+        return false;
+    }
+    // after restore only the oldest snapshot is left, new ones replace the dropped future
+    if(!pushAndRestore(large, history, 1, 200, rng, out)) return false;
+
+    // small ring: old keyframes are evicted together with their deltas, ring wraps many times
+    RewindBuffer small(sizeof(Snapshot) * 3, 4);
+    if(!pushAndRestore(small, history, 0, 400, rng, out)) return false;
+    if(small.oldestFrame() == 0 || small.oldestFrame() % 4) {
+        out << "rewind buffer evicted frames wrongly, oldest frame is " << small.oldestFrame() << std::endl;
+        return false;
+    }
+    // frame before the history restores the oldest snapshot
+    const Snapshot* oldest = small.restore(0);
+    if(!oldest || oldest->ppu.frame != small.oldestFrame() || small.snapshotsCount() != 1) {
+        out << "rewind buffer restored wrong snapshot for frame before its history" << std::endl;
+        return false;
+    }
+
+    // ring is smaller than a keyframe: nothing is stored
+    RewindBuffer tiny(sizeof(Snapshot) / 2, 4);
+    std::memcpy(&tiny.snapshot(), &history[0], sizeof(Snapshot));
+    tiny.push();
+    if(tiny.snapshotsCount() || tiny.restore(0)) {
+        out << "rewind buffer stored snapshot, which doesn't fit" << std::endl;
+        return false;
+    }
+    out << "rewind buffer: encoding, restoring and eviction OK" << std::endl;
+    return true;
+}
+
+bool selfTestSpriteEvaluation(const std::string& romName, Logger* logger, std::ostream& out) {
+    NES batch(romName, logger), dots(romName, logger);
+    dots.getPpu().setScanlineRendering(false);
+    std::mt19937_64 rng(16);
+    auto stateBatch = std::make_unique<PPUState>(), stateDots = std::make_unique<PPUState>();
+    batch.getPpu().saveState(*stateBatch);
+    u64 overflowFrames = 0;
+    for(int frame = 0; frame < 120; ++frame) {
+        // PPUs are at the start of prerender scanline: sprites are crowded into a band of lines, so some lines have more than 8 of them
+        std::array<u8, 0x100> oam;
+        u8 band = rng() % 240;
+        u8 spread = rng() % 2 ? 16 : 240;
+        for(std::size_t i = 0; i < oam.size(); ++i) oam[i] = i % 4 ? rng() : band + rng() % spread;
+        u8 ctrl = rng() & 0b00111000;
+        u8 mask = (rng() % 4 ? 0b00011000 : rng() & 0b00011000) | (rng() & 0b110);
+        u8 oamaddr = rng() % 4 ? 0 : rng();
+        for(NES* nes : {&batch, &dots}) {
+            std::copy(oam.begin(), oam.end(), nes->getPpu().getOAM().begin());
+            nes->getPpu().accessPPURegisters().writePpuctrl(ctrl).writePpumask(mask).writeOamaddr(oamaddr);
+        }
+        bool overflow = false;
+        for(int line = -1; line < 261; ++line) {
+            u32 length = (stateBatch->scanline == -1 && stateBatch->frame % 2) ? 340 : 341;
+            for(NES* nes : {&batch, &dots}) {
+                nes->getPpu().addMasterCycles(length);
+                nes->getPpu().catchUp();
+            }
+            batch.getPpu().saveState(*stateBatch);
+            dots.getPpu().saveState(*stateDots);
+            if(std::memcmp(stateBatch.get(), stateDots.get(), sizeof(PPUState))) {
+                out << "sprite evaluation: scanline " << line << " of frame " << frame << " differs from dot by dot rendering" << std::endl;
+                return false;
+            }
+            overflow = overflow || (stateBatch->registers.ppustatus & 0b00100000);
+        }
+        overflowFrames += overflow;
+    }
+    out << "sprite evaluation: 120 frames are the same as dot by dot, sprite overflow is set in " << overflowFrames << " of them" << std::endl;
+    return true;
+}
+
+bool selfTestRewind(const std::string& romName, u64 frames, Logger* logger, std::ostream& out) {
+    NES nes(romName, logger);
+    nes.setThrottling(false);
+    nes.enableRewind(64 << 20);
+    // frame number -> hash after it is finished
+    std::map<u64, u64> hashes;
+    u64 mismatches = 0;
+    auto runTo = [&](u64 lastFrame) {
+        while(nes.getPpu().currentFrame() < lastFrame) {
+            nes.runFrames(1);
+            u64 hash = hashFrameAndRAM(nes, nes.getPpu().getRenderFrame());
+            auto it = hashes.find(nes.getPpu().currentFrame());
+            if(it == hashes.end()) hashes[nes.getPpu().currentFrame()] = hash;
+            else if(it->second != hash) ++mismatches;
+        }
+    };
+    runTo(frames);
+    // crossing keyframes(every 60th) and going past the beginning of history
+    const u64 amounts[] = {1, 2, 7, 59, 60, 61, frames / 2, frames * 2};
+    for(u64 amount : amounts) {
+        u64 frame = nes.getPpu().currentFrame();
+        u64 rewound = nes.rewind(amount);
+        if(rewound < std::min(amount, frame)) {
+            out << "rewind by " << amount << " frames went back only by " << rewound << std::endl;
+            return false;
+        }
+        runTo(frame);
+    }
+    if(mismatches) {
+        out << "rewind: " << mismatches << " frames differ after rewinding" << std::endl;
+        return false;
+    }
+    out << "rewind: " << hashes.size() << " frames are the same after rewinding" << std::endl;
+    return true;
+}
+
+bool selfTestJIT(const std::string& romName, u64 frames, Logger* logger, std::ostream& out) {
+    NES blocks(romName, logger), interpreter(romName, logger);
+    blocks.setThrottling(false);
+    interpreter.setThrottling(false);
+    if(!blocks.getCpu().jitAvailable()) out << "jit: not available, translated blocks are interpreted" << std::endl;
+    auto snapshotBlocks = std::make_unique<Snapshot>(), snapshotInterpreter = std::make_unique<Snapshot>();
+    u64 syncPoints = 0;
+    while(blocks.getPpu().currentFrame() < frames) {
+        u64 frame = blocks.getPpu().currentFrame();
+        Address pc = blocks.getCpu().registers().PC;
+        blocks.doInstructions();
+        // block(or skipped idle loop) ends on instruction boundary, which interpreter also reaches
+        while(interpreter.getCpu().getInstructionCounter() < blocks.getCpu().getInstructionCounter()) interpreter.doInstruction();
+        ++syncPoints;
+        const Registers& expected = interpreter.getCpu().registers();
+        const Registers& result = blocks.getCpu().registers();
+        if(interpreter.getCpu().getInstructionCounter() != blocks.getCpu().getInstructionCounter() || expected.PC != result.PC
+           || expected.A != result.A || expected.X != result.X || expected.Y != result.Y || expected.S != result.S
+           || expected.status() != result.status() || interpreter.getPpu().masterCycles() != blocks.getPpu().masterCycles()) {
+            out << "jit: block at $" << numToHexStr(pc, 4) << " differs from interpreter after instruction "
+                << blocks.getCpu().getInstructionCounter() << std::endl;
+            return false;
+        }
+        if(blocks.getPpu().currentFrame() != frame) {
+            blocks.saveSnapshot(*snapshotBlocks);
+            interpreter.saveSnapshot(*snapshotInterpreter);
+            if(snapshotBlocks->cpu.memory != snapshotInterpreter->cpu.memory || snapshotBlocks->ppu.memory != snapshotInterpreter->ppu.memory) {
+                out << "jit: memory differs from interpreter after frame " << frame << std::endl;
+                return false;
+            }
+        }
+    }
+    u64 total = blocks.getCpu().getInstructionCounter();
+    u64 native = blocks.getCpu().getNativeInstructionCounter();
+    out << "jit: " << syncPoints << " blocks are the same as interpreter, " << native << " of " << total
+        << " instructions(" << (total ? native * 100 / total : 0) << "%) executed natively" << std::endl;
+    return true;
+}
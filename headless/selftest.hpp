@@ -0,0 +1,28 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "core/include/common.hpp"
+#include "log/log.hpp"
+
+/*
+    Self-tests of the parts, which can't be checked by just playing the game: results should be exactly the same
+        as of the straightforward path, not just look right. Each test prints what it has checked into 'out'
+        and returns false on the first mismatch.
+*/
+
+// vectorized versions of Compositor against the scalar one on random scanlines(versions, not supported by CPU, are skipped)
+bool selfTestCompositor(std::ostream& out);
+// RewindBuffer alone on synthetic snapshots: encoding of keyframes and deltas, dropping the future, eviction from a small ring
+bool selfTestRewindBuffer(std::ostream& out);
+/*
+    drives PPUs of the game without CPU through frames of random crowded sprites(sprite size, OAMADDR and PPUMASK are random too):
+        one renders whole scanlines at once, other - dot by dot, their states(secondary OAM, sprite overflow etc.) should be the same after every scanline
+*/
+bool selfTestSpriteEvaluation(const std::string& romName, Logger* logger, std::ostream& out);
+// runs the game for 'frames' frames, rewinds by different amounts and runs again: frames and RAM should be the same
+bool selfTestRewind(const std::string& romName, u64 frames, Logger* logger, std::ostream& out);
+/*
+    runs the game for 'frames' frames by blocks(native code of JIT, where it's available) and by interpreter in lockstep:
+        registers and master clock should be the same after every block, RAM and VRAM - after every frame
+*/
+bool selfTestJIT(const std::string& romName, u64 frames, Logger* logger, std::ostream& out);
@@ -17,15 +17,13 @@ int main(int argc, char *argv[])
     mw.show();
 
     // if I init sdl from Qt widget(main window), it won't start
-    GuiSDL* gui = new GuiSDL(256, 240, reinterpret_cast<void*>(mw.getRenderWidget()->winId()));
-    mw.setRenderer(gui);
+    mw.startRenderer();
 
     //mw.loadRom("/home/onyazuka/cpp/ProjectsMy/HaniwaNES/roms/Super Mario Bros./Super Mario Bros. (W) [!].nes");
 
     a.exec();
 
     delete oslogger;
-    delete gui;
 
     return 0;
 }
@@ -9,14 +9,20 @@ NES::NES(const std::string &romFname, Logger* _logger)
       ppu{ppuMemory, eventQueue, _logger},
       memory{*mapper, ppu, stController1, stController2},
       cpu{memory, ppu, eventQueue, _logger},
+      rewindBuffer{},
+      rewindInterval{1},
+      nextRewindFrame{0},
       logger{_logger}
 {
+    mapper->setEventQueue(&eventQueue);
     //ppu.setDrawDebugGrid(true);
 }
 
 // Both save and load guarantee, that CPU's event queue is empty
 void NES::save(const std::string& fname) {
     waitUntilEventQueueIsEmpty();
+    // PPU state should be actual
+    ppu.catchUp();
 
     std::ofstream ofs;
     ofs.open(fname, std::ios_base::binary);
@@ -46,8 +52,80 @@ void NES::load(const std::string& fname) {
     data.resize(fsize);
     ifs.read(&(data[0]), fsize);
     Serialization::Deserializer::deserializeAll(data, 0, &ppu, &cpu, mapper.get());
+    // rewind history after the loaded frame is dropped on the next snapshot
+    nextRewindFrame = ppu.currentFrame() + 1;
+}
+
+void NES::saveSnapshot(Snapshot& snapshot) {
+    // PPU state should be actual
+    ppu.catchUp();
+    snapshot.version = Snapshot::Version;
+    snapshot.mapper = rom.header()->mapper();
+    cpu.saveState(snapshot.cpu);
+    ppu.saveState(snapshot.ppu);
+    mapper->saveState(snapshot.mapperState);
+    stController1.saveState(snapshot.controllers[0]);
+    stController2.saveState(snapshot.controllers[1]);
+    snapshot.events = eventQueue;
+}
+
+void NES::loadSnapshot(const Snapshot& snapshot) {
+    if(snapshot.version != Snapshot::Version || snapshot.mapper != rom.header()->mapper()) {
+        if(logger) logger->log(LogLevel::Error, "Snapshot is taken from another ROM or another version of emulator!");
+        throw InvalidSnapshotException{};
+    }
+    // mapper restores its IRQ line in the event queue, and PPU computes its next event from mapper's state
+    eventQueue = snapshot.events;
+    mapper->loadState(snapshot.mapperState);
+    ppu.loadState(snapshot.ppu);
+    cpu.loadState(snapshot.cpu);
+    stController1.loadState(snapshot.controllers[0]);
+    stController2.loadState(snapshot.controllers[1]);
+    nextRewindFrame = ppu.currentFrame() + 1;
+}
+
+void NES::enableRewind(std::size_t memoryLimit, u32 interval, u32 keyframeInterval) {
+    rewindBuffer = std::make_unique<RewindBuffer>(memoryLimit, keyframeInterval);
+    rewindInterval = std::max<u32>(interval, 1);
+    nextRewindFrame = ppu.currentFrame();
+}
+
+void NES::disableRewind() {
+    rewindBuffer.reset();
+}
+
+u64 NES::rewind(u64 frames) {
+    if(!rewindBuffer) return 0;
+    u64 frame = ppu.currentFrame();
+    const Snapshot* snapshot = rewindBuffer->restore(frames < frame ? frame - frames : 0);
+    if(!snapshot) return 0;
+    loadSnapshot(*snapshot);
+    nextRewindFrame = snapshot->ppu.frame + rewindInterval;
+    return frame - ppu.currentFrame();
+}
+
+void NES::runFrames(u64 frames) {
+    u64 lastFrame = ppu.currentFrame() + frames;
+    while(ppu.currentFrame() < lastFrame) doInstructions();
+}
+
+void NES::runCycles(u64 cycles) {
+    // master clock counts PPU cycles
+    u64 lastCycle = ppu.masterCycles() + cycles * 3;
+    while(ppu.masterCycles() < lastCycle) doInstruction();
+}
+
+void NES::runUntil(const std::function<bool(NES&)>& predicate) {
+    while(!predicate(*this)) doInstruction();
+}
+
+void NES::takeRewindSnapshot() {
+    saveSnapshot(rewindBuffer->snapshot());
+    rewindBuffer->push();
+    nextRewindFrame = ppu.currentFrame() + rewindInterval;
 }
 
 void NES::waitUntilEventQueueIsEmpty() {
-    while(!cpu.eventQueueEmpty()) cpu.exec();
+    // IRQ lines are part of their sources state, and they are saved with them
+    while(eventQueue.oneShotPending()) cpu.exec();
 }
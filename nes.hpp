@@ -1,8 +1,11 @@
 #pragma once
+#include <functional>
 #include "core/include/cpu.hpp"
 #include "core/include/ppu.hpp"
 #include "core/include/rom.hpp"
 #include "core/include/input.hpp"
+#include "core/include/snapshot.hpp"
+#include "core/include/rewind.hpp"
 
 class InvalidFileException{};
 
@@ -10,9 +13,38 @@ class NES {
 public:
     NES(const std::string& romFname, Logger* logger=nullptr);
 
-    inline void doInstruction() { cpu.exec(); }
+    inline void doInstruction() { cpu.exec(); checkRewind(); }
+    // executes translated block of instructions
+    inline void doInstructions() { cpu.execBlock(); checkRewind(); }
+    /*
+        Headless running: it doesn't need GUI, and, with throttling disabled, runs as fast as possible.
+        Frames, produced meanwhile, are published into PPU's frame queue as usual(the newest one can be taken with getPpu().getRenderFrame()).
+    */
+    void runFrames(u64 frames);
+    // runs at least 'cycles' CPU cycles(stops on the first instruction boundary after them)
+    void runCycles(u64 cycles);
+    // runs until predicate is true(it is checked after each instruction)
+    void runUntil(const std::function<bool(NES&)>& predicate);
+    inline void setThrottling(bool enabled) { cpu.setThrottling(enabled); }
+    // skipped frames are emulated, but not drawn and not pushed to PPU's frame queue
+    inline void setFrameskip(u32 frames) { cpu.setFrameskip(frames); }
+    inline void setAutoFrameskip(bool enabled) { cpu.setAutoFrameskip(enabled); }
     void save(const std::string& fname);
     void load(const std::string& fname);
+    /*
+        In-memory snapshot of the whole state(see Snapshot). Unlike save/load, it works at any instruction boundary
+            and doesn't allocate. Should be called from the thread, which runs emulation.
+    */
+    void saveSnapshot(Snapshot& snapshot);
+    void loadSnapshot(const Snapshot& snapshot);
+    /*
+        Rewind: snapshot is taken on the first instruction of every 'interval'-th frame into the ring of 'memoryLimit' bytes(see RewindBuffer).
+        rewind() goes back at least 'frames' frames(or as far as history allows) and returns the number of frames actually rewound.
+    */
+    void enableRewind(std::size_t memoryLimit, u32 interval = 1, u32 keyframeInterval = 60);
+    void disableRewind();
+    u64 rewind(u64 frames);
+    inline const RewindBuffer* getRewindBuffer() const { return rewindBuffer.get(); }
 
     inline ROM& getRom() { return rom; }
     inline PPU& getPpu() { return ppu; }
@@ -20,6 +52,8 @@ public:
     inline StandardController& getController(int num) { if(num == 0) return stController1; else return stController2; }
 private:
     void waitUntilEventQueueIsEmpty();
+    inline void checkRewind() { if(rewindBuffer && ppu.currentFrame() >= nextRewindFrame) takeRewindSnapshot(); }
+    void takeRewindSnapshot();
 
     ROM rom;
     StandardController stController1;
@@ -30,5 +64,8 @@ private:
     PPU ppu;
     Memory memory;
     CPU cpu;
+    Uptr<RewindBuffer> rewindBuffer;
+    u32 rewindInterval;
+    u64 nextRewindFrame;
     Logger* logger;
 };
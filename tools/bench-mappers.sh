@@ -0,0 +1,40 @@
+#!/bin/bash
+# Per-frame time of the same test game(see mkrom.py) built for different mappers.
+# Usage: bench-mappers.sh <HaniwaNESHeadless> [frames] [runs]
+# ROMs are run in turn 'runs' times(so frequency changes and other load hit all of them), the best time is printed.
+set -e
+headless=${1:?Usage: $0 <HaniwaNESHeadless> [frames] [runs]}
+frames=${2:-1000}
+runs=${3:-7}
+tools=$(dirname "$0")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+names=()
+rom() {
+    names+=("$1")
+    python3 "$tools/mkrom.py" "$dir/$1.nes" "${@:2}"
+}
+
+rom mapper0 --mapper 0
+# the same program, only mapper's registers are written on reset
+rom mapper1 --mapper 1
+rom mapper4 --mapper 4
+# scanline counter clocked by PPU and IRQ scheduled every 21 scanlines(handler only acknowledges it)
+rom mapper4-scanline-irq --mapper 4 --scanline-irq 20
+# the same IRQ, which also writes CHR bank registers mid-frame
+rom mapper4-irq-chr-switching --mapper 4 --scanline-irq 20 --irq-chr-switching
+rom mapper1-bank-switching --mapper 1 --bank-switching
+rom mapper4-bank-switching --mapper 4 --bank-switching
+rom mapper4-bank-switching-irq --mapper 4 --bank-switching --scanline-irq 20
+
+declare -A best
+for ((i = 0; i < runs; ++i)); do
+    for name in "${names[@]}"; do
+        time=$("$headless" "$dir/$name.nes" "$frames" | sed -n 's/.*time: \([0-9.e-]*\)s.*/\1/p')
+        best[$name]=$(echo "$time ${best[$name]}" | awk '{ print ($2 == "" || $1 < $2) ? $1 : $2 }')
+    done
+done
+for name in "${names[@]}"; do
+    echo "$name ${best[$name]}" | awk -v frames="$frames" '{ printf "%-28s %8.2f us per frame\n", $1, $2 * 1e6 / frames }'
+done
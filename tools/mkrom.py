@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""
+Generates a small test game for benchmarks: the same program and data for different mappers,
+so the difference in per-frame time is the cost of the mapper.
+
+Game: background of random tiles, 64 sprites, moved every frame(OAM DMA in NMI),
+sprite 0 hit polling, PPUSTATUS polling or busy loop until the next NMI.
+Apart from the mapper setup and bank switching code, program and data are the same for every mapper,
+and so are the frames(nothing visible depends on exact timing of the code).
+
+Usage: mkrom.py <out.nes> [--mapper 0|1|4] [--bank-switching] [--scanline-irq N] [--irq-chr-switching] [--seed N]
+    --bank-switching switches CHR and PRG banks in every NMI(ignored for mapper 0), to the same banks for every mapper.
+    --scanline-irq enables MMC3 scanline IRQ every N + 1 scanlines(mapper 4 only). IRQ handler only acknowledges it,
+        so frames are the same as without it, and the difference is the cost of scanline counter and IRQ.
+    --irq-chr-switching makes IRQ handler also write CHR bank registers R2-R5(with the banks they already have),
+        like games, which switch CHR banks mid-frame, do.
+"""
+import argparse
+import random
+import struct
+
+# minimal 6502 assembler: program is a list of labels and (operation, mode, argument) tuples
+OPS = {
+    ('LDA', 'imm'): 0xA9, ('LDA', 'zp'): 0xA5, ('LDA', 'abs'): 0xAD, ('LDA', 'absx'): 0xBD,
+    ('LDX', 'imm'): 0xA2, ('LDY', 'imm'): 0xA0, ('LDA', 'absy'): 0xB9,
+    ('STA', 'zp'): 0x85, ('STA', 'abs'): 0x8D, ('STA', 'absx'): 0x9D, ('STY', 'abs'): 0x8C,
+    ('INC', 'zp'): 0xE6, ('INC', 'absx'): 0xFE,
+    ('CMP', 'zp'): 0xC5, ('CPX', 'imm'): 0xE0, ('CPY', 'imm'): 0xC0,
+    ('AND', 'imm'): 0x29, ('ORA', 'imm'): 0x09, ('EOR', 'zp'): 0x45,
+    ('BIT', 'abs'): 0x2C, ('JMP', 'abs'): 0x4C,
+    ('BPL', 'rel'): 0x10, ('BNE', 'rel'): 0xD0, ('BEQ', 'rel'): 0xF0, ('BVC', 'rel'): 0x50, ('BVS', 'rel'): 0x70,
+    ('SEI', None): 0x78, ('CLI', None): 0x58, ('INY', None): 0xC8, ('CLD', None): 0xD8, ('TXS', None): 0x9A, ('INX', None): 0xE8, ('DEY', None): 0x88,
+    ('PHA', None): 0x48, ('PLA', None): 0x68, ('TXA', None): 0x8A, ('TAX', None): 0xAA, ('TYA', None): 0x98, ('TAY', None): 0xA8,
+    ('RTI', None): 0x40, ('LSR', None): 0x4A, ('ASL', None): 0x0A,
+}
+SIZE = {'imm': 2, 'zp': 2, 'abs': 3, 'absx': 3, 'absy': 3, 'rel': 2, None: 1}
+
+
+def assemble(program, org):
+    labels = {}
+    # the first pass only collects labels
+    for final in (False, True):
+        pc = org
+        out = bytearray()
+        for item in program:
+            if isinstance(item, str):
+                labels[item] = pc
+                continue
+            if item[0] == 'DB':
+                out += bytes(item[1])
+                pc += len(item[1])
+                continue
+            op, mode = item[0], item[1] if len(item) > 1 else None
+            arg = item[2] if len(item) > 2 else None
+            if isinstance(arg, str):
+                arg = labels.get(arg, pc)
+            out.append(OPS[(op, mode)])
+            if mode == 'rel':
+                offset = arg - (pc + 2)
+                if final:
+                    assert -128 <= offset <= 127, (op, arg, pc)
+                out.append(offset & 0xFF)
+            elif SIZE[mode] == 2:
+                out.append(arg & 0xFF)
+            elif SIZE[mode] == 3:
+                out += struct.pack('<H', arg & 0xFFFF)
+            pc += SIZE[mode]
+    return out, labels
+
+
+def header(prg16, chr8, mapper, mirroring=1):
+    return b'NES\x1a' + bytes([prg16, chr8, (mapper & 0xF) << 4 | mirroring, mapper & 0xF0]) + bytes(8)
+
+
+def mapper_init(mapper):
+    p = []
+    if mapper == 1:
+        # reset shift register, then control: vertical mirroring, PRG mode 3($C000 fixed), CHR 4K banks
+        p += [('LDA', 'imm', 0x80), ('STA', 'abs', 0x8000)]
+        for addr, val in ((0x8000, 0x1E), (0xA000, 0), (0xC000, 1), (0xE000, 0)):
+            for i in range(5):
+                p += [('LDA', 'imm', (val >> i) & 1), ('STA', 'abs', addr)]
+    elif mapper == 4:
+        # the same layout as above: linear CHR(R0-R5), PRG banks 0, 1 at $8000(R6, R7), vertical mirroring
+        p += [('LDY', 'imm', 0), 'mmc3init', ('STY', 'abs', 0x8000), ('LDA', 'absy', 'mmc3banks'), ('STA', 'abs', 0x8001),
+              ('INY',), ('CPY', 'imm', 8), ('BNE', 'rel', 'mmc3init'),
+              ('LDA', 'imm', 0), ('STA', 'abs', 0xA000)]
+    return p
+
+
+def mapper_nmi(mapper):
+    p = []
+    if mapper == 1:
+        # CHR bank 0 and PRG bank at $8000 are taken from the frame counter, 5 serial writes each
+        p += [('LDA', 'zp', 0x11), ('AND', 'imm', 3)]
+        for i in range(5):
+            p += [('STA', 'abs', 0xA000), ('LSR',)]
+        p += [('LDA', 'zp', 0x11), ('LSR',), ('LSR',), ('AND', 'imm', 7)]
+        for i in range(5):
+            p += [('STA', 'abs', 0xE000), ('LSR',)]
+    elif mapper == 4:
+        # the same banks in 1 KB CHR and 8 KB PRG units
+        p += [('LDA', 'imm', 0), ('STA', 'abs', 0x8000), ('LDA', 'zp', 0x11), ('AND', 'imm', 3), ('ASL',), ('ASL',), ('STA', 'abs', 0x8001), ('STA', 'zp', 0x12),
+              ('LDA', 'imm', 1), ('STA', 'abs', 0x8000), ('LDA', 'zp', 0x12), ('ORA', 'imm', 2), ('STA', 'abs', 0x8001),
+              ('LDA', 'imm', 6), ('STA', 'abs', 0x8000), ('LDA', 'zp', 0x11), ('LSR',), ('LSR',), ('AND', 'imm', 7), ('ASL',), ('STA', 'abs', 0x8001), ('STA', 'zp', 0x12),
+              ('LDA', 'imm', 7), ('STA', 'abs', 0x8000), ('LDA', 'zp', 0x12), ('ORA', 'imm', 1), ('STA', 'abs', 0x8001)]
+    return p
+
+
+def game(mapper, seed, bank_switching, scanline_irq, irq_chr_switching):
+    rnd = random.Random(seed)
+    ctrl = 0xA8    # NMI, 8x16 sprites
+    p = ['reset', ('SEI',), ('CLD',), ('LDX', 'imm', 0xFF), ('TXS',), ('LDA', 'imm', 0), ('STA', 'abs', 0x2000), ('STA', 'abs', 0x2001)]
+    p += mapper_init(mapper)
+    p += ['vw1', ('BIT', 'abs', 0x2002), ('BPL', 'rel', 'vw1'), 'vw2', ('BIT', 'abs', 0x2002), ('BPL', 'rel', 'vw2')]
+    # palettes, nametable and OAM from the tables below
+    p += [('LDA', 'imm', 0x3F), ('STA', 'abs', 0x2006), ('LDA', 'imm', 0), ('STA', 'abs', 0x2006), ('LDX', 'imm', 0),
+          'pal', ('LDA', 'absx', 'paltab'), ('STA', 'abs', 0x2007), ('INX',), ('CPX', 'imm', 32), ('BNE', 'rel', 'pal')]
+    p += [('LDA', 'imm', 0x20), ('STA', 'abs', 0x2006), ('LDA', 'imm', 0), ('STA', 'abs', 0x2006), ('LDY', 'imm', 16), ('LDX', 'imm', 0),
+          'nt', ('LDA', 'absx', 'nttab'), ('EOR', 'zp', 0x00), ('STA', 'abs', 0x2007), ('INX',), ('BNE', 'rel', 'nt'),
+          ('INC', 'zp', 0x00), ('DEY',), ('BNE', 'rel', 'nt')]
+    p += [('LDX', 'imm', 0), 'oam', ('LDA', 'absx', 'oamtab'), ('STA', 'absx', 0x0200), ('INX',), ('BNE', 'rel', 'oam')]
+    p += [('LDA', 'imm', 0), ('STA', 'abs', 0x2005), ('STA', 'abs', 0x2005),
+          ('LDA', 'imm', ctrl), ('STA', 'abs', 0x2000), ('LDA', 'imm', 0x1E), ('STA', 'abs', 0x2001)]
+    if mapper == 4 and scanline_irq is not None:
+        # I flag is set on reset, so IRQ is unmasked only here
+        p += [('LDA', 'imm', scanline_irq), ('STA', 'abs', 0xC000), ('STA', 'abs', 0xC001), ('STA', 'abs', 0xE001), ('CLI',)]
+    # main loop: wait for NMI, wait for sprite 0 hit, write PPUMASK, then busy loop or PPUSTATUS polling until the next NMI
+    # PPUMASK write after sprite 0 hit doesn't change it: frame doesn't depend on exact timing of the code, which differs between mappers
+    p += ['main', ('LDA', 'zp', 0x11), 'wf', ('CMP', 'zp', 0x11), ('BEQ', 'rel', 'wf'),
+          's0c', ('BIT', 'abs', 0x2002), ('BVS', 'rel', 's0c'),
+          's0', ('BIT', 'abs', 0x2002), ('BVC', 'rel', 's0'),
+          ('LDA', 'imm', 0x1E), ('STA', 'abs', 0x2001),
+          ('LDA', 'zp', 0x11), ('AND', 'imm', 3), ('BNE', 'rel', 'poll'),
+          'busy', ('INC', 'zp', 0x10), ('LDA', 'zp', 0x11), ('AND', 'imm', 1), ('BEQ', 'rel', 'busy'), ('JMP', 'abs', 'main'),
+          'poll', ('LDA', 'abs', 0x2002), ('BPL', 'rel', 'poll'), ('JMP', 'abs', 'main')]
+    # NMI: OAM DMA, update a palette entry and a nametable byte, scroll, banks - all in vblank; then move sprites for the next frame
+    p += ['nmi', ('PHA',), ('TXA',), ('PHA',), ('TYA',), ('PHA',),
+          ('LDA', 'imm', 0x02), ('STA', 'abs', 0x4014), ('INC', 'zp', 0x11),
+          ('LDA', 'abs', 0x2002), ('LDA', 'imm', 0x3F), ('STA', 'abs', 0x2006), ('LDA', 'imm', 0x11), ('STA', 'abs', 0x2006),
+          ('LDA', 'zp', 0x11), ('AND', 'imm', 0x3F), ('STA', 'abs', 0x2007),
+          ('LDA', 'imm', 0x20), ('STA', 'abs', 0x2006), ('LDA', 'zp', 0x11), ('STA', 'abs', 0x2006), ('STA', 'abs', 0x2007),
+          ('LDA', 'abs', 0x2002), ('LDA', 'zp', 0x11), ('STA', 'abs', 0x2005), ('LSR',), ('STA', 'abs', 0x2005),
+          ('LDA', 'zp', 0x11), ('AND', 'imm', 1), ('ORA', 'imm', ctrl), ('STA', 'abs', 0x2000)]
+    if bank_switching:
+        p += mapper_nmi(mapper)
+    p += [('LDX', 'imm', 4), 'mv', ('INC', 'absx', 0x0203), ('INC', 'absx', 0x0200), ('INX',), ('INX',), ('INX',), ('INX',), ('BNE', 'rel', 'mv'),
+          ('PLA',), ('TAY',), ('PLA',), ('TAX',), ('PLA',), ('RTI',)]
+    # IRQ: acknowledge and enable again, count IRQs
+    p += ['irq', ('STA', 'abs', 0xE000), ('STA', 'abs', 0xE001), ('INC', 'zp', 0x13)]
+    if irq_chr_switching:
+        # NMI selects the register before every bank data write, so it doesn't mind the changed bank select
+        p += [('PHA',), ('TYA',), ('PHA',), ('LDY', 'imm', 2),
+              'irqchr', ('STY', 'abs', 0x8000), ('LDA', 'absy', 'mmc3banks'), ('STA', 'abs', 0x8001),
+              ('INY',), ('CPY', 'imm', 6), ('BNE', 'rel', 'irqchr'),
+              ('PLA',), ('TAY',), ('PLA',)]
+    p += [('RTI',)]
+    oam = []
+    for i in range(64):
+        oam += [rnd.randrange(0, 239), rnd.randrange(256), rnd.randrange(256), rnd.randrange(256)]
+    # sprite 0 is an opaque tile over the background
+    oam[0:4] = [60, 1, 0, 100]
+    p += ['paltab', ('DB', [rnd.randrange(64) for _ in range(32)]),
+          'nttab', ('DB', [rnd.randrange(256) for _ in range(256)]),
+          'oamtab', ('DB', oam),
+          'mmc3banks', ('DB', [0, 2, 4, 5, 6, 7, 0, 1])]
+
+    code, labels = assemble(p, 0xC000)
+    assert len(code) < 0x3FFA, len(code)
+    bank = bytearray(code) + bytes(0x4000 - len(code))
+    bank[0x3FFA:0x3FFC] = struct.pack('<H', labels['nmi'])
+    bank[0x3FFC:0x3FFE] = struct.pack('<H', labels['reset'])
+    bank[0x3FFE:0x4000] = struct.pack('<H', labels['irq'])
+    # program is in the last 16 KB bank, other banks and CHR are random, the same for every mapper
+    prg_filler = random.Random(seed + 1)
+    prg16 = 2 if mapper == 0 else 8
+    prg = b''.join(bytes(prg_filler.randrange(256) for _ in range(0x4000)) for _ in range(prg16 - 1)) + bytes(bank)
+    chr_filler = random.Random(seed + 2)
+    chr8 = 1 if mapper == 0 else 2
+    chr_data = bytearray(chr_filler.randrange(256) for _ in range(0x2000 * chr8))
+    chr_data[16:32] = b'\xff' * 16
+    return header(prg16, chr8, mapper) + prg + bytes(chr_data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generates a test game for benchmarks.')
+    parser.add_argument('out')
+    parser.add_argument('--mapper', type=int, choices=(0, 1, 4), default=0)
+    parser.add_argument('--bank-switching', action='store_true')
+    parser.add_argument('--scanline-irq', type=int, metavar='N', help='MMC3 IRQ latch value')
+    parser.add_argument('--irq-chr-switching', action='store_true', help='write CHR bank registers in IRQ handler')
+    parser.add_argument('--seed', type=int, default=1234)
+    args = parser.parse_args()
+    with open(args.out, 'wb') as f:
+        f.write(game(args.mapper, args.seed, args.bank_switching, args.scanline_irq, args.irq_chr_switching))
+
+
+if __name__ == '__main__':
+    main()